@@ -0,0 +1,289 @@
+// C API of the engine library, see cppchess.h. main.cpp is included directly like
+// in microbench.cpp, so the library runs exactly the engine's code.
+
+#define CPPCHESS_NO_MAIN
+#include "main.cpp"
+
+#include "cppchess.h"
+
+static_assert(CPPCHESS_FEN_LENGTH >= MAX_FEN_LENGTH, "cppchess_get_fen writes up to MAX_FEN_LENGTH bytes");
+
+struct cppchess_engine {
+	Engine engine[1];
+
+	cppchess_progress progress;
+	void *progressData;
+
+	// the last completed iteration, an interrupted one leaves only a partial pv behind
+	cppchess_info last;
+};
+
+static void ApiProgress(int depth, int score, void *data)
+{
+	cppchess_engine *api = (cppchess_engine *)data;
+	cppchess_info *info = &api->last;
+
+	info->depth = depth;
+	info->score = score;
+	info->mate = score > MATE_SCORE ? (MATE_VALUE - score + 1) / 2 : score < -MATE_SCORE ? -(MATE_VALUE + score) / 2 : 0;
+	info->nodes = sInfo->nodes;
+	info->time = getTimeMS() - sInfo->starttime;
+	info->pv_length = ss->pvLength[0];
+
+	for (int i = 0; i < info->pv_length; i++)
+		info->pv[i] = ss->pvTable[0][i];
+
+	if (api->progress)
+		api->progress(info, api->progressData);
+}
+
+// source, target and the promotion piece pick the move, the caller need not know the other flags
+static int ApiFindMove(int move)
+{
+	MoveList moves[1];
+	GenerateMoves(moves);
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		int candidate = moves->moves[i].move;
+
+		if (getSource(candidate) != getSource(move) || getTarget(candidate) != getTarget(move))
+			continue;
+
+		if (getPromotion(candidate) != getPromotion(move))
+			continue;
+
+		if (getPromotion(move) && (getFlag(candidate) & 3) != (getFlag(move) & 3))
+			continue;
+
+		return candidate;
+	}
+
+	return 0;
+}
+
+extern "C" {
+
+cppchess_engine *cppchess_create(int hash_mb)
+{
+	cppchess_engine *api = new cppchess_engine();
+
+	BindEngine(api->engine);
+
+	if (!InitHash(hash_mb > 0 ? hash_mb : DEFAULT_HASH_MB, "") || !InitEvalCache(DEFAULT_EVAL_CACHE_MB))
+	{
+		FreeHash();
+		delete api;
+		return NULL;
+	}
+
+	sInfo->uci = 0;
+
+	ClearHistory();
+	ParseFen(pos, startPosition);
+
+	return api;
+}
+
+void cppchess_destroy(cppchess_engine *api)
+{
+	if (!api)
+		return;
+
+	BindEngine(api->engine);
+	FreeHash();
+	FreeEvalCache();
+
+	delete api;
+}
+
+void cppchess_new_game(cppchess_engine *api)
+{
+	BindEngine(api->engine);
+	ClearHash();
+	ClearHistory();
+
+	sInfo->stopRequest = false;
+}
+
+int cppchess_set_fen(cppchess_engine *api, const char *fen)
+{
+	return cppchess_set_moves(api, fen, NULL, 0);
+}
+
+int cppchess_set_moves(cppchess_engine *api, const char *fen, const uint16_t *moves, int count)
+{
+	Position saved = *api->engine->pos;
+
+	BindEngine(api->engine);
+
+	// a stop left over from the previous search must not cut short the one for this position
+	sInfo->stopRequest = false;
+
+	bool valid = ParseFen(pos, fen ? fen : startPosition);
+
+	// game moves are made at ply 0 so their keys stay in the repetition history
+	ss->ply = 0;
+
+	for (int i = 0; valid && i < count; i++)
+	{
+		int move = ApiFindMove(moves[i]);
+
+		valid = move && pos->histPly < MAX_GAME_PLY - MAX_PLY && MakeMove(move);
+	}
+
+	if (!valid)
+	{
+		*pos = saved;
+		return -1;
+	}
+
+	return 0;
+}
+
+int cppchess_set_board(cppchess_engine *api, const cppchess_board *board)
+{
+	Position saved = *api->engine->pos;
+
+	BindEngine(api->engine);
+
+	sInfo->stopRequest = false;
+
+	pos->reset();
+
+	for (int sq = 0; sq < 64; sq++)
+	{
+		int piece = board->squares[sq];
+
+		if (piece == NO_PIECE)
+			continue;
+
+		if (piece > NO_PIECE)
+		{
+			*pos = saved;
+			return -1;
+		}
+
+		setBit(pos->bb[piece], sq);
+		pos->mailbox[sq] = piece;
+	}
+
+	for (int piece = P; piece <= K; piece++)
+		pos->occ[WHITE] |= pos->bb[piece];
+
+	for (int piece = p; piece <= k; piece++)
+		pos->occ[BLACK] |= pos->bb[piece];
+
+	pos->occ[BOTH] = pos->occ[WHITE] | pos->occ[BLACK];
+
+	pos->side = board->side ? BLACK : WHITE;
+	pos->ca = board->castling & 15;
+	pos->ep = board->enpassant >= 0 && board->enpassant < 64 ? board->enpassant : noSq;
+	pos->fifty = max(0, min(MAX_FEN_COUNTER, board->fifty));
+	pos->fullmove = max(1, min(MAX_FEN_COUNTER, board->fullmove));
+	pos->hashKey = generateHashKey(pos);
+
+	if (PositionError(pos))
+	{
+		*pos = saved;
+		return -1;
+	}
+
+	return 0;
+}
+
+void cppchess_get_board(cppchess_engine *api, cppchess_board *board)
+{
+	Position *current = api->engine->pos;
+
+	memcpy(board->squares, current->mailbox, sizeof(board->squares));
+
+	board->side = current->side;
+	board->castling = current->ca;
+	board->enpassant = current->ep;
+	board->fifty = current->fifty;
+	board->fullmove = current->fullmove;
+}
+
+void cppchess_get_fen(cppchess_engine *api, char *buffer)
+{
+	WriteFen(api->engine->pos, buffer);
+}
+
+int cppchess_legal_moves(cppchess_engine *api, uint16_t *legal)
+{
+	int count = 0;
+	MoveList moves[1];
+
+	BindEngine(api->engine);
+	GenerateMoves(moves);
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		if (MakeMove(moves->moves[i].move))
+		{
+			legal[count++] = moves->moves[i].move;
+			TakeBack();
+		}
+	}
+
+	return count;
+}
+
+uint16_t cppchess_search(cppchess_engine *api, const cppchess_limits *limits,
+	cppchess_progress progress, void *data, cppchess_info *result)
+{
+	BindEngine(api->engine);
+
+	api->progress = progress;
+	api->progressData = data;
+
+	memset(&api->last, 0, sizeof(api->last));
+
+	sInfo->progress = ApiProgress;
+	sInfo->progressData = api;
+
+	sInfo->starttime = getTimeMS();
+	sInfo->timeset = limits && limits->movetime > 0;
+	sInfo->stoptime = sInfo->starttime + (limits ? limits->movetime : 0);
+	sInfo->nodeLimit = limits ? limits->nodes : 0;
+
+	// a stop that came before the search started ends it at once, so it is cleared only afterwards
+	SearchPosition(limits && limits->depth > 0 ? min(limits->depth, MAX_PLY - 1) : MAX_PLY - 1);
+
+	sInfo->progress = NULL;
+	sInfo->stopRequest = false;
+
+	if (result)
+	{
+		*result = api->last;
+		result->nodes = sInfo->nodes;
+		result->time = getTimeMS() - sInfo->starttime;
+	}
+
+	return sInfo->bestMove;
+}
+
+void cppchess_stop(cppchess_engine *api)
+{
+	api->engine->sInfo->stopRequest = true;
+}
+
+uint64_t cppchess_perft(cppchess_engine *api, int depth)
+{
+	BindEngine(api->engine);
+
+	sInfo->nodes = 0;
+	ss->ply = 0;
+
+	Perft(depth);
+
+	return sInfo->nodes;
+}
+
+void cppchess_move_string(uint16_t move, char *buffer)
+{
+	snprintf(buffer, 6, "%s", MoveString(move).c_str());
+}
+
+}
@@ -0,0 +1,113 @@
+/*
+ * C API of the engine library, built with "make lib" as libcppchess.a and libcppchess.so.
+ *
+ * Every engine owns its board, search state and hash table, so any number of engines can
+ * be used from any number of threads. One engine must not be used by two threads at the
+ * same time, except for cppchess_stop.
+ *
+ * Squares are numbered a8 = 0, b8 = 1, ... h1 = 63. Moves are 16 bits: source square in
+ * bits 0-5, target square in bits 6-11 and a flag in bits 12-15. Moves passed in only need
+ * source, target and, for promotions, a promotion flag: 8 knight, 9 bishop, 10 rook,
+ * 11 queen. Moves returned carry the full flag.
+ */
+
+#ifndef CPPCHESS_H
+#define CPPCHESS_H
+
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define CPPCHESS_API __attribute__((visibility("default")))
+#else
+#define CPPCHESS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cppchess_engine cppchess_engine;
+
+/* piece codes of cppchess_board, the same order as the engine uses */
+enum {
+	CPPCHESS_WP, CPPCHESS_WN, CPPCHESS_WB, CPPCHESS_WR, CPPCHESS_WQ, CPPCHESS_WK,
+	CPPCHESS_BP, CPPCHESS_BN, CPPCHESS_BB, CPPCHESS_BR, CPPCHESS_BQ, CPPCHESS_BK,
+	CPPCHESS_EMPTY
+};
+
+/* castling bits of cppchess_board */
+enum { CPPCHESS_WHITE_OO = 1, CPPCHESS_WHITE_OOO = 2, CPPCHESS_BLACK_OO = 4, CPPCHESS_BLACK_OOO = 8 };
+
+typedef struct {
+	uint8_t squares[64];
+	int side;        /* 0 white, 1 black */
+	int castling;
+	int enpassant;   /* square behind the pawn that just moved two squares, or 64 */
+	int fifty;
+	int fullmove;
+} cppchess_board;
+
+/* zero fields are no limit, a search without any limit runs until cppchess_stop */
+typedef struct {
+	int depth;
+	int64_t nodes;
+	int movetime;    /* milliseconds */
+} cppchess_limits;
+
+typedef struct {
+	int depth;
+	int score;       /* centipawns from the side to move */
+	int mate;        /* moves to mate, negative when getting mated, 0 when no mate is seen */
+	int64_t nodes;
+	int time;        /* milliseconds */
+	int pv_length;
+	uint16_t pv[64];
+} cppchess_info;
+
+/* called on the searching thread after every completed iteration */
+typedef void (*cppchess_progress)(const cppchess_info *info, void *data);
+
+/* returns NULL when the hash table cannot be allocated, the position is the start position */
+CPPCHESS_API cppchess_engine *cppchess_create(int hash_mb);
+CPPCHESS_API void cppchess_destroy(cppchess_engine *engine);
+
+/* clears the hash table and the move ordering history for a new game, searches within
+   a game keep what ordering learnt */
+CPPCHESS_API void cppchess_new_game(cppchess_engine *engine);
+
+/* the set functions return 0 on success and -1 when the position or a move is invalid,
+   the engine keeps its previous position on failure */
+CPPCHESS_API int cppchess_set_fen(cppchess_engine *engine, const char *fen);
+CPPCHESS_API int cppchess_set_board(cppchess_engine *engine, const cppchess_board *board);
+
+/* plays moves from a FEN, or from the start position when fen is NULL */
+CPPCHESS_API int cppchess_set_moves(cppchess_engine *engine, const char *fen, const uint16_t *moves, int count);
+
+CPPCHESS_API void cppchess_get_board(cppchess_engine *engine, cppchess_board *board);
+
+/* writes the position as a FEN with all six fields, buffer needs CPPCHESS_FEN_LENGTH bytes */
+#define CPPCHESS_FEN_LENGTH 100
+CPPCHESS_API void cppchess_get_fen(cppchess_engine *engine, char *buffer);
+
+/* fills moves with the legal moves of the position, returns the count, at most 256 */
+CPPCHESS_API int cppchess_legal_moves(cppchess_engine *engine, uint16_t *moves);
+
+/* blocks until the search ends, returns the best move or 0 when there is no legal move,
+   result may be NULL */
+CPPCHESS_API uint16_t cppchess_search(cppchess_engine *engine, const cppchess_limits *limits,
+	cppchess_progress progress, void *data, cppchess_info *result);
+
+/* safe to call from any thread; a stop sent before cppchess_search starts ends that search
+   at once, new_game and the set functions discard a pending stop */
+CPPCHESS_API void cppchess_stop(cppchess_engine *engine);
+
+CPPCHESS_API uint64_t cppchess_perft(cppchess_engine *engine, int depth);
+
+/* writes the move in UCI notation, buffer needs 6 bytes */
+CPPCHESS_API void cppchess_move_string(uint16_t move, char *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
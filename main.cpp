@@ -1,35 +1,122 @@
 #include <iostream>
 #include <cstring>
 #include <map>
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 #include <sys/time.h>
+#include <sys/select.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <cmath>
 
 using namespace std;
 
-#define setBit(bb, bit) (bb |= (1ULL << bit))
-#define popBit(bb, bit) (bb &= ~(1ULL << bit))
-#define getBit(bb, bit) ((bb >> bit) & 1ULL)
-
-#define Move(source, target, piece, promoted, capture, doublePawn, enpassant, castling) \
-    (source) |          \
-    (target << 6) |     \
-    (piece << 12) |     \
-    (promoted << 16) |  \
-    (capture << 20) |   \
-    (doublePawn << 21) | \
-    (enpassant << 22) | \
-    (castling << 23)    \
-
-#define getSource(move) (move & 0x3f)
-#define getTarget(move) ((move & 0xfc0) >> 6)
-#define getPiece(move) ((move & 0xf000) >> 12)
-#define getPromoted(move) ((move & 0xf0000) >> 16)
-#define getCapture(move) (move & 0x100000)
-#define getDouble(move) (move & 0x200000)
-#define getEnpassant(move) (move & 0x400000)
-#define getCastling(move) (move & 0x800000)
+#define setBit(bb, bit) ((bb) |= (1ULL << (bit)))
+#define popBit(bb, bit) ((bb) &= ~(1ULL << (bit)))
+#define getBit(bb, bit) (((bb) >> (bit)) & 1ULL)
+
+// a move is 16 bits: source, target and a 4-bit flag, the moving piece is read from the mailbox
+enum MoveFlag {
+	QUIET, DOUBLE_PUSH, KING_CASTLE, QUEEN_CASTLE, CAPTURE, EP_CAPTURE,
+	PROMO_N = 8, PROMO_B, PROMO_R, PROMO_Q, PROMO_N_CAPTURE, PROMO_B_CAPTURE, PROMO_R_CAPTURE, PROMO_Q_CAPTURE
+};
+
+#define Move(source, target, flag) ((source) | ((target) << 6) | ((flag) << 12))
+
+#define getSource(move) ((move) & 0x3f)
+#define getTarget(move) (((move) >> 6) & 0x3f)
+#define getFlag(move) (((move) >> 12) & 0xf)
+#define getCapture(move) ((move) & 0x4000)
+#define getPromotion(move) ((move) & 0x8000)
+#define getDouble(move) (getFlag(move) == DOUBLE_PUSH)
+#define getEnpassant(move) (getFlag(move) == EP_CAPTURE)
+#define getCastling(move) (getFlag(move) == KING_CASTLE || getFlag(move) == QUEEN_CASTLE)
+
+// both read the position the move belongs to, so only use them before the move is made
+#define getPiece(move) (pos->mailbox[getSource(move)])
+#define getPromoted(move) (getPromotion(move) ? N + (getFlag(move) & 3) + 6 * pos->side : 0)
+
+#define INF 50000
+#define MATE_VALUE 49000
+#define MATE_SCORE 48000
+#define MAX_PLY 64
+#define MAX_GAME_PLY 2048
+
+#define HASH_EXACT 0
+#define HASH_ALPHA 1
+#define HASH_BETA 2
+#define NO_HASH_ENTRY 100000
+#define DEFAULT_HASH_MB 16
+#define DEFAULT_EVAL_CACHE_MB 2
+#define MAX_MULTIPV 256
+#define BENCH_DEPTH 5
+
+// six FEN fields with counters of up to MAX_FEN_COUNTER, and the terminating zero
+#define MAX_FEN_LENGTH 100
+#define MAX_FEN_COUNTER 99999
+
+// self-play defaults, games are adjudicated once a side is this far ahead
+#define DATAGEN_NODES 5000
+#define DATAGEN_RANDOM_PLIES 8
+#define DATAGEN_WIN_SCORE 2500
+
+// self-play and match games that run this long are drawn
+#define GAME_MAX_PLIES 400
+
+// match defaults: a win is adjudicated once both engines agree on the score for MATCH_WIN_PLIES
+// plies in a row, a draw once both stay within MATCH_DRAW_SCORE after MATCH_DRAW_START plies
+#define MATCH_GAMES 1000
+#define MATCH_WIN_SCORE 1000
+#define MATCH_WIN_PLIES 6
+#define MATCH_DRAW_SCORE 10
+#define MATCH_DRAW_PLIES 16
+#define MATCH_DRAW_START 80
+#define MATCH_TIME_MARGIN 1000
+#define MATCH_HANDSHAKE_MS 10000
+
+// PGN files are cut into chunks of about this size for the extract-pgn workers
+#define PGN_CHUNK_SIZE (16 << 20)
+
+// move ordering keys, each history table stays within +-HISTORY_MAX so quiet moves never pass a counter move
+#define HASH_MOVE_SCORE 2000000
+#define CAPTURE_SCORE 1000000
+#define KILLER_SCORE 900000
+#define COUNTER_SCORE 800000
+#define HISTORY_MAX 16384
+
+// bump whenever HashEntry or the index scheme changes, old hash files are then discarded
+#define HASH_FORMAT_VERSION 4
+#define HASH_BUCKET_SIZE 4
+#define HASH_AGE_MASK 63
+#define LARGE_PAGE_SIZE (2 << 20)
+
+// build with -DSEARCH_STATS to collect search counters, otherwise they compile away
+#ifdef SEARCH_STATS
+#define STAT(expr) (expr)
+#define STAT_TIME(counter, expr) do { uint64_t statStart = StatClock(); expr; stats->counter += StatClock() - statStart; } while (0)
+#else
+#define STAT(expr)
+#define STAT_TIME(counter, expr) expr
+#endif
+
+#define TB_PIECES 7
+#define TB_WIN_SCORE 47000
+#define TB_MAX_DTZ (1 << 18)
 
 enum Side { WHITE, BLACK, BOTH };
-enum Pieces { P, N, B, R, Q, K, p, n, b, r, q, k };
+enum Pieces { P, N, B, R, Q, K, p, n, b, r, q, k, NO_PIECE };
 enum Castling { WK = 1, WQ = 2, BK = 4, BQ = 8 };
 
 enum Square {
@@ -43,6 +130,22 @@ enum Square {
     a1, b1, c1, d1, e1, f1, g1, h1, noSq
 };
 
+enum { ATTACKS_WHITE = 1, ATTACKS_BLACK = 2, ATTACKS_PINS = 4 };
+
+// attack maps of one position, filled on first use and saved with the board by CopyBoard
+class AttackCache {
+public:
+	// squares attacked by each piece type and by each side, the other side's king does not block
+	uint64_t byPiece[12];
+	uint64_t bySide[2];
+
+	// pieces giving check and side-to-move pieces pinned to their king
+	uint64_t checkers;
+	uint64_t pinned;
+
+	int valid;
+};
+
 class Position {
 public:
 	int side;
@@ -53,11 +156,19 @@ public:
 	uint64_t bb[12];
 	uint64_t occ[3];
 
-	int ply;
+	// piece on each square or NO_PIECE, kept in step with bb
+	uint8_t mailbox[64];
+
+	AttackCache attacks;
+
+	// halfmove clock for the fifty-move rule and FEN move number
+	int fifty;
+	int fullmove;
+
+	// keys of all positions before the current one, game moves first then the search line
+	uint64_t hashHistory[MAX_GAME_PLY];
+	int histPly;
 
-	int pvTable[64][64];
-	int pvLength[64];
-	
 	void reset()
 	{
 		side = 0;
@@ -67,8 +178,13 @@ public:
 
 		memset(bb, 0, sizeof(bb));
 		memset(occ, 0, sizeof(occ));
+		memset(mailbox, NO_PIECE, sizeof(mailbox));
 
-		ply = 0;
+		attacks.valid = 0;
+
+		fifty = 0;
+		fullmove = 1;
+		histPly = 0;
 	}
 };
 
@@ -86,57 +202,311 @@ public:
 	int stoptime = 0;
 	int timeset = 0;
 	bool stopped = 0;
+
+	// lines reported per iteration, each searched with the better ones excluded at the root
+	int multiPV = 1;
+
+	// go ponder and go infinite: no bestmove before ponderhit or stop, and pondering runs
+	// off the clock until ponderhit starts it
+	bool ponder = 0;
+	bool infinite = 0;
+
+	// stop after exactly this many nodes, so a search with only a node limit is reproducible
+	long nodeLimit = 0;
+
+	// only the UCI thread polls stdin and prints search output
+	bool uci = 1;
+
+	// set from another thread to stop the search, picked up with the clock
+	atomic<bool> stopRequest{false};
+
+	// called after every completed iteration, embedders use it instead of the info lines
+	void (*progress)(int depth, int score, void *data) = NULL;
+	void *progressData = NULL;
+
+	// random state for weighted book picks, seeded on the first pick so engines sharing the book differ
+	uint64_t bookSeed = 0;
+
+	// result of the last completed iteration
+	int bestMove = 0;
+	int bestScore = 0;
+};
+
+#ifdef SEARCH_STATS
+class SearchStats {
+public:
+	long nodesPerPly[MAX_PLY];
+	long iterationNodes[MAX_PLY];
+	long qnodes;
+
+	long hashProbes;
+	long hashHits;
+	long hashCutoffs;
+
+	long evalProbes;
+	long evalHits;
+
+	long betaCutoffs;
+	long firstMoveCutoffs;
+
+	// pseudo-legal moves made and the ones MakeMove rejected
+	long moves;
+	long illegalMoves;
+
+	// nanoseconds
+	uint64_t genTime;
+	uint64_t evalTime;
+};
+#endif
+
+// a move next to its ordering key, so a selection sort step reads one array
+class ScoredMove {
+public:
+	int score;
+	uint16_t move;
 };
 
 class MoveList {
 public:
-	int moves[256];
+	ScoredMove moves[256];
 	int count;
 };
 
+// per-search state that belongs to the thread running the search, not to the board
+// one MultiPV line of an iteration, kept until all lines are searched and can be ranked
+class RootLine {
+public:
+	int score;
+	int length;
+	uint16_t pv[MAX_PLY];
+};
+
+class SearchStack {
+public:
+	// distance from the search root
+	int ply = 0;
+
+	uint16_t pvTable[64][64];
+	int pvLength[64];
+
+	// move made at each ply and the piece that made it, for the counter and continuation tables
+	uint16_t moves[MAX_PLY];
+	uint8_t pieces[MAX_PLY];
+
+	// quiet moves that caused a beta cutoff, two per ply, and butterfly history by piece and target
+	uint16_t killers[MAX_PLY][2];
+	int history[12][64];
+
+	// the quiet reply that refuted a move, and history of quiet moves following a move,
+	// both indexed by the earlier move's piece and target
+	uint16_t counterMoves[12][64];
+	int16_t continuation[12][64][12][64];
+
+	// root moves of the lines already searched in this iteration, MultiPV skips them
+	uint16_t rootExcluded[MAX_MULTIPV];
+	int rootExcludedCount = 0;
+	RootLine rootLines[MAX_MULTIPV];
+
+	// go searchmoves, the only root moves searched when there are any
+	uint16_t searchMoves[256];
+	int searchMoveCount = 0;
+};
+
 class Undo {
 public:
 	uint64_t bb[64][12];
 	uint64_t occ[64][3];
+	uint8_t mailbox[64][64];
+	AttackCache attacks[64];
+
+	uint64_t hashKey[64];
 
 	int ca[64];
 	int ep[64];
 	int side[64];
+	int fifty[64];
+	int fullmove[64];
+};
+
+// memory-mapped Polyglot .bin file, 16 byte big-endian entries sorted by key
+class PolyglotBook {
+public:
+	const unsigned char *entries = NULL;
+	size_t count = 0;
+	size_t size = 0;
+
+	bool enabled = 0;
+	bool bestMove = 0;
+};
+
+class HashEntry {
+public:
+	uint64_t key;
+	int32_t score;
+	uint16_t move;
+	uint8_t depth;
+
+	// the bound and the search generation that stored the entry share the last byte
+	uint8_t flag : 2;
+	uint8_t age : 6;
+};
+
+static_assert(sizeof(HashEntry) == 16, "four entries fill a cache line");
+
+// one cache line, a probe touches a single line whatever entry it finds
+class alignas(64) HashBucket {
+public:
+	HashEntry entries[HASH_BUCKET_SIZE];
+};
+
+// first 64 bytes of a hash file, buckets follow
+class HashFileHeader {
+public:
+	char magic[8];
+	uint32_t version;
+	uint32_t bucketSize;
+	uint64_t seed;
+	uint64_t count;
+	uint8_t age;        // generation of the current search, kept across sessions in a file
+	unsigned char reserved[31];
+};
+
+// the table lives in an anonymous mapping, or in a shared file mapping when HashFile is set
+class HashTable {
+public:
+	HashFileHeader *header = NULL;
+	HashBucket *buckets = NULL;
+	uint64_t count = 0;
+	size_t size = 0;
+
+	int mb = DEFAULT_HASH_MB;
+	string path;
+};
+
+// static evals by hashKey, one word per entry: the key above the low 16 bits and the
+// side-relative score in them, so threads sharing a cache never read a torn entry
+class EvalCache {
+public:
+	uint64_t *entries = NULL;
+	uint64_t mask = 0;
+	size_t size = 0;
+
+	int mb = DEFAULT_EVAL_CACHE_MB;
+};
+
+// everything one game or analysis owns, engines share only the read-only tables
+// so one process can run many of them, each thread binds the engine it works on
+class Engine {
+public:
+	Position pos[1];
+	Undo undo[1];
+	SearchStack ss[1];
+	SearchInfo sInfo[1];
+	HashTable hashTable[1];
+	EvalCache evalCache[1];
+
+#ifdef SEARCH_STATS
+	SearchStats stats[1];
+#endif
+};
+
+enum { WDL_LOSS = -2, WDL_BLESSED_LOSS, WDL_DRAW, WDL_CURSED_WIN, WDL_WIN };
+enum { PROBE_FAIL, PROBE_OK, PROBE_CHANGE_STM, PROBE_ZEROING_BEST_MOVE };
+enum { TB_STM = 1, TB_MAPPED = 2, TB_WIN_PLIES = 4, TB_LOSS_PLIES = 8, TB_WIDE = 16, TB_SINGLE_VALUE = 128 };
+
+// one compressed subtable of a Syzygy file, per side to move and leading pawn file
+class PairsData {
+public:
+	int flags = 0;
+	int maxSymLen = 0;
+	int minSymLen = 0;
+	uint32_t numBlocks = 0;
+	uint64_t sizeofBlock = 0;
+	uint64_t span = 0;
+	uint32_t blockLengthSize = 0;
+	uint64_t sparseIndexSize = 0;
+
+	const unsigned char *lowestSym = NULL;
+	const unsigned char *btree = NULL;
+	const unsigned char *blockLength = NULL;
+	const unsigned char *sparseIndex = NULL;
+	const unsigned char *data = NULL;
+
+	vector<uint64_t> base64;
+	vector<uint8_t> symlen;
+
+	int pieces[TB_PIECES] = { 0 };
+	uint64_t groupIdx[TB_PIECES + 1] = { 0 };
+	int groupLen[TB_PIECES + 1] = { 0 };
+	uint16_t mapIdx[4] = { 0 };
+};
+
+class TBTable {
+public:
+	string name;
+	string path;
+	bool isDTZ = 0;
+
+	uint64_t key = 0;
+	uint64_t key2 = 0;
+	int pieceCount = 0;
+	bool hasPawns = 0;
+	bool hasUniquePieces = 0;
+	int pawnCount[2] = { 0, 0 };
+
+	// the file is mapped on first probe
+	atomic<bool> ready{false};
+	bool failed = 0;
+	void *base = NULL;
+	size_t size = 0;
+
+	const unsigned char *map = NULL;
+	PairsData items[2][4];
 };
 
-map<int, char> pieceToChar = {
-    {P, 'P'},
-    {N, 'N'},
-    {B, 'B'},
-    {R, 'R'},
-    {Q, 'Q'},
-    {K, 'K'},
-    {p, 'p'},
-    {n, 'n'},
-    {b, 'b'},
-    {r, 'r'},
-    {q, 'q'},
-    {k, 'k'},
+class Tablebases {
+public:
+	vector<string> paths;
+	deque<TBTable> tables;
+
+	// WDL and DTZ tables by material key of either colour
+	map<uint64_t, TBTable *> wdl;
+	map<uint64_t, TBTable *> dtz;
+	mutex mapLock;
+
+	int largest = 0;
+	int probeLimit = TB_PIECES;
 };
 
-map<char, int> charToPiece = {
-    {'P', P},
-    {'N', N},
-    {'B', B},
-    {'R', R},
-    {'Q', Q},
-    {'K', K},
-    {'p', p},
-    {'n', n},
-    {'b', b},
-    {'r', r},
-    {'q', q},
-    {'k', k},
+// FEN letters by piece
+const char pieceChars[] = "PNBRQKpnbrqk";
+
+// FEN characters to pieces and castling bits, NO_PIECE and 0 for anything else
+class FenTables {
+public:
+	uint8_t piece[256] = {};
+	uint8_t castling[256] = {};
+
+	constexpr FenTables()
+	{
+		for (int c = 0; c < 256; c++)
+			piece[c] = NO_PIECE;
+
+		for (int pc = P; pc <= k; pc++)
+			piece[(uint8_t)pieceChars[pc]] = pc;
+
+		castling['K'] = WK;
+		castling['Q'] = WQ;
+		castling['k'] = BK;
+		castling['q'] = BQ;
+	}
 };
 
+constexpr FenTables fenTables;
+
 string unicodePieces[12] = {"♙", "♘", "♗", "♖", "♕", "♔", "♟︎", "♞", "♝", "♜", "♛", "♚"};
 
-const int bishopRelevantBits[64] = {
+constexpr int bishopRelevantBits[64] = {
 	6, 5, 5, 5, 5, 5, 5, 6,
 	5, 5, 5, 5, 5, 5, 5, 5,
 	5, 5, 7, 7, 7, 7, 5, 5,
@@ -147,7 +517,7 @@ const int bishopRelevantBits[64] = {
 	6, 5, 5, 5, 5, 5, 5, 6
 };
 
-const int rookRelevantBits[64] = {
+constexpr int rookRelevantBits[64] = {
 	12, 11, 11, 11, 11, 11, 11, 12,
 	11, 10, 10, 10, 10, 10, 10, 11,
 	11, 10, 10, 10, 10, 10, 10, 11,
@@ -158,7 +528,7 @@ const int rookRelevantBits[64] = {
 	12, 11, 11, 11, 11, 11, 11, 12
 };
 
-uint64_t rookMagicNumbers[64] = {
+constexpr uint64_t rookMagicNumbers[64] = {
 	0x8a80104000800020ULL,
 	0x140002000100040ULL,
 	0x2801880a0017001ULL,
@@ -225,7 +595,7 @@ uint64_t rookMagicNumbers[64] = {
 	0x1004081002402ULL
 };
 
-uint64_t bishopMagicNumbers[64] = {
+constexpr uint64_t bishopMagicNumbers[64] = {
 	0x40040844404084ULL,
 	0x2004208a004208ULL,
 	0x10190041080202ULL,
@@ -292,6 +662,206 @@ uint64_t bishopMagicNumbers[64] = {
 	0x4010011029020020ULL
 };
 
+// Polyglot book keys: 12 * 64 piece-square keys, 4 castling, 8 enpassant file and 1 side key
+const uint64_t polyglotRandom[781] = {
+	0x9D39247E33776D41ULL, 0x2AF7398005AAA5C7ULL, 0x44DB015024623547ULL, 0x9C15F73E62A76AE2ULL,
+	0x75834465489C0C89ULL, 0x3290AC3A203001BFULL, 0x0FBBAD1F61042279ULL, 0xE83A908FF2FB60CAULL,
+	0x0D7E765D58755C10ULL, 0x1A083822CEAFE02DULL, 0x9605D5F0E25EC3B0ULL, 0xD021FF5CD13A2ED5ULL,
+	0x40BDF15D4A672E32ULL, 0x011355146FD56395ULL, 0x5DB4832046F3D9E5ULL, 0x239F8B2D7FF719CCULL,
+	0x05D1A1AE85B49AA1ULL, 0x679F848F6E8FC971ULL, 0x7449BBFF801FED0BULL, 0x7D11CDB1C3B7ADF0ULL,
+	0x82C7709E781EB7CCULL, 0xF3218F1C9510786CULL, 0x331478F3AF51BBE6ULL, 0x4BB38DE5E7219443ULL,
+	0xAA649C6EBCFD50FCULL, 0x8DBD98A352AFD40BULL, 0x87D2074B81D79217ULL, 0x19F3C751D3E92AE1ULL,
+	0xB4AB30F062B19ABFULL, 0x7B0500AC42047AC4ULL, 0xC9452CA81A09D85DULL, 0x24AA6C514DA27500ULL,
+	0x4C9F34427501B447ULL, 0x14A68FD73C910841ULL, 0xA71B9B83461CBD93ULL, 0x03488B95B0F1850FULL,
+	0x637B2B34FF93C040ULL, 0x09D1BC9A3DD90A94ULL, 0x3575668334A1DD3BULL, 0x735E2B97A4C45A23ULL,
+	0x18727070F1BD400BULL, 0x1FCBACD259BF02E7ULL, 0xD310A7C2CE9B6555ULL, 0xBF983FE0FE5D8244ULL,
+	0x9F74D14F7454A824ULL, 0x51EBDC4AB9BA3035ULL, 0x5C82C505DB9AB0FAULL, 0xFCF7FE8A3430B241ULL,
+	0x3253A729B9BA3DDEULL, 0x8C74C368081B3075ULL, 0xB9BC6C87167C33E7ULL, 0x7EF48F2B83024E20ULL,
+	0x11D505D4C351BD7FULL, 0x6568FCA92C76A243ULL, 0x4DE0B0F40F32A7B8ULL, 0x96D693460CC37E5DULL,
+	0x42E240CB63689F2FULL, 0x6D2BDCDAE2919661ULL, 0x42880B0236E4D951ULL, 0x5F0F4A5898171BB6ULL,
+	0x39F890F579F92F88ULL, 0x93C5B5F47356388BULL, 0x63DC359D8D231B78ULL, 0xEC16CA8AEA98AD76ULL,
+	0x5355F900C2A82DC7ULL, 0x07FB9F855A997142ULL, 0x5093417AA8A7ED5EULL, 0x7BCBC38DA25A7F3CULL,
+	0x19FC8A768CF4B6D4ULL, 0x637A7780DECFC0D9ULL, 0x8249A47AEE0E41F7ULL, 0x79AD695501E7D1E8ULL,
+	0x14ACBAF4777D5776ULL, 0xF145B6BECCDEA195ULL, 0xDABF2AC8201752FCULL, 0x24C3C94DF9C8D3F6ULL,
+	0xBB6E2924F03912EAULL, 0x0CE26C0B95C980D9ULL, 0xA49CD132BFBF7CC4ULL, 0xE99D662AF4243939ULL,
+	0x27E6AD7891165C3FULL, 0x8535F040B9744FF1ULL, 0x54B3F4FA5F40D873ULL, 0x72B12C32127FED2BULL,
+	0xEE954D3C7B411F47ULL, 0x9A85AC909A24EAA1ULL, 0x70AC4CD9F04F21F5ULL, 0xF9B89D3E99A075C2ULL,
+	0x87B3E2B2B5C907B1ULL, 0xA366E5B8C54F48B8ULL, 0xAE4A9346CC3F7CF2ULL, 0x1920C04D47267BBDULL,
+	0x87BF02C6B49E2AE9ULL, 0x092237AC237F3859ULL, 0xFF07F64EF8ED14D0ULL, 0x8DE8DCA9F03CC54EULL,
+	0x9C1633264DB49C89ULL, 0xB3F22C3D0B0B38EDULL, 0x390E5FB44D01144BULL, 0x5BFEA5B4712768E9ULL,
+	0x1E1032911FA78984ULL, 0x9A74ACB964E78CB3ULL, 0x4F80F7A035DAFB04ULL, 0x6304D09A0B3738C4ULL,
+	0x2171E64683023A08ULL, 0x5B9B63EB9CEFF80CULL, 0x506AACF489889342ULL, 0x1881AFC9A3A701D6ULL,
+	0x6503080440750644ULL, 0xDFD395339CDBF4A7ULL, 0xEF927DBCF00C20F2ULL, 0x7B32F7D1E03680ECULL,
+	0xB9FD7620E7316243ULL, 0x05A7E8A57DB91B77ULL, 0xB5889C6E15630A75ULL, 0x4A750A09CE9573F7ULL,
+	0xCF464CEC899A2F8AULL, 0xF538639CE705B824ULL, 0x3C79A0FF5580EF7FULL, 0xEDE6C87F8477609DULL,
+	0x799E81F05BC93F31ULL, 0x86536B8CF3428A8CULL, 0x97D7374C60087B73ULL, 0xA246637CFF328532ULL,
+	0x043FCAE60CC0EBA0ULL, 0x920E449535DD359EULL, 0x70EB093B15B290CCULL, 0x73A1921916591CBDULL,
+	0x56436C9FE1A1AA8DULL, 0xEFAC4B70633B8F81ULL, 0xBB215798D45DF7AFULL, 0x45F20042F24F1768ULL,
+	0x930F80F4E8EB7462ULL, 0xFF6712FFCFD75EA1ULL, 0xAE623FD67468AA70ULL, 0xDD2C5BC84BC8D8FCULL,
+	0x7EED120D54CF2DD9ULL, 0x22FE545401165F1CULL, 0xC91800E98FB99929ULL, 0x808BD68E6AC10365ULL,
+	0xDEC468145B7605F6ULL, 0x1BEDE3A3AEF53302ULL, 0x43539603D6C55602ULL, 0xAA969B5C691CCB7AULL,
+	0xA87832D392EFEE56ULL, 0x65942C7B3C7E11AEULL, 0xDED2D633CAD004F6ULL, 0x21F08570F420E565ULL,
+	0xB415938D7DA94E3CULL, 0x91B859E59ECB6350ULL, 0x10CFF333E0ED804AULL, 0x28AED140BE0BB7DDULL,
+	0xC5CC1D89724FA456ULL, 0x5648F680F11A2741ULL, 0x2D255069F0B7DAB3ULL, 0x9BC5A38EF729ABD4ULL,
+	0xEF2F054308F6A2BCULL, 0xAF2042F5CC5C2858ULL, 0x480412BAB7F5BE2AULL, 0xAEF3AF4A563DFE43ULL,
+	0x19AFE59AE451497FULL, 0x52593803DFF1E840ULL, 0xF4F076E65F2CE6F0ULL, 0x11379625747D5AF3ULL,
+	0xBCE5D2248682C115ULL, 0x9DA4243DE836994FULL, 0x066F70B33FE09017ULL, 0x4DC4DE189B671A1CULL,
+	0x51039AB7712457C3ULL, 0xC07A3F80C31FB4B4ULL, 0xB46EE9C5E64A6E7CULL, 0xB3819A42ABE61C87ULL,
+	0x21A007933A522A20ULL, 0x2DF16F761598AA4FULL, 0x763C4A1371B368FDULL, 0xF793C46702E086A0ULL,
+	0xD7288E012AEB8D31ULL, 0xDE336A2A4BC1C44BULL, 0x0BF692B38D079F23ULL, 0x2C604A7A177326B3ULL,
+	0x4850E73E03EB6064ULL, 0xCFC447F1E53C8E1BULL, 0xB05CA3F564268D99ULL, 0x9AE182C8BC9474E8ULL,
+	0xA4FC4BD4FC5558CAULL, 0xE755178D58FC4E76ULL, 0x69B97DB1A4C03DFEULL, 0xF9B5B7C4ACC67C96ULL,
+	0xFC6A82D64B8655FBULL, 0x9C684CB6C4D24417ULL, 0x8EC97D2917456ED0ULL, 0x6703DF9D2924E97EULL,
+	0xC547F57E42A7444EULL, 0x78E37644E7CAD29EULL, 0xFE9A44E9362F05FAULL, 0x08BD35CC38336615ULL,
+	0x9315E5EB3A129ACEULL, 0x94061B871E04DF75ULL, 0xDF1D9F9D784BA010ULL, 0x3BBA57B68871B59DULL,
+	0xD2B7ADEEDED1F73FULL, 0xF7A255D83BC373F8ULL, 0xD7F4F2448C0CEB81ULL, 0xD95BE88CD210FFA7ULL,
+	0x336F52F8FF4728E7ULL, 0xA74049DAC312AC71ULL, 0xA2F61BB6E437FDB5ULL, 0x4F2A5CB07F6A35B3ULL,
+	0x87D380BDA5BF7859ULL, 0x16B9F7E06C453A21ULL, 0x7BA2484C8A0FD54EULL, 0xF3A678CAD9A2E38CULL,
+	0x39B0BF7DDE437BA2ULL, 0xFCAF55C1BF8A4424ULL, 0x18FCF680573FA594ULL, 0x4C0563B89F495AC3ULL,
+	0x40E087931A00930DULL, 0x8CFFA9412EB642C1ULL, 0x68CA39053261169FULL, 0x7A1EE967D27579E2ULL,
+	0x9D1D60E5076F5B6FULL, 0x3810E399B6F65BA2ULL, 0x32095B6D4AB5F9B1ULL, 0x35CAB62109DD038AULL,
+	0xA90B24499FCFAFB1ULL, 0x77A225A07CC2C6BDULL, 0x513E5E634C70E331ULL, 0x4361C0CA3F692F12ULL,
+	0xD941ACA44B20A45BULL, 0x528F7C8602C5807BULL, 0x52AB92BEB9613989ULL, 0x9D1DFA2EFC557F73ULL,
+	0x722FF175F572C348ULL, 0x1D1260A51107FE97ULL, 0x7A249A57EC0C9BA2ULL, 0x04208FE9E8F7F2D6ULL,
+	0x5A110C6058B920A0ULL, 0x0CD9A497658A5698ULL, 0x56FD23C8F9715A4CULL, 0x284C847B9D887AAEULL,
+	0x04FEABFBBDB619CBULL, 0x742E1E651C60BA83ULL, 0x9A9632E65904AD3CULL, 0x881B82A13B51B9E2ULL,
+	0x506E6744CD974924ULL, 0xB0183DB56FFC6A79ULL, 0x0ED9B915C66ED37EULL, 0x5E11E86D5873D484ULL,
+	0xF678647E3519AC6EULL, 0x1B85D488D0F20CC5ULL, 0xDAB9FE6525D89021ULL, 0x0D151D86ADB73615ULL,
+	0xA865A54EDCC0F019ULL, 0x93C42566AEF98FFBULL, 0x99E7AFEABE000731ULL, 0x48CBFF086DDF285AULL,
+	0x7F9B6AF1EBF78BAFULL, 0x58627E1A149BBA21ULL, 0x2CD16E2ABD791E33ULL, 0xD363EFF5F0977996ULL,
+	0x0CE2A38C344A6EEDULL, 0x1A804AADB9CFA741ULL, 0x907F30421D78C5DEULL, 0x501F65EDB3034D07ULL,
+	0x37624AE5A48FA6E9ULL, 0x957BAF61700CFF4EULL, 0x3A6C27934E31188AULL, 0xD49503536ABCA345ULL,
+	0x088E049589C432E0ULL, 0xF943AEE7FEBF21B8ULL, 0x6C3B8E3E336139D3ULL, 0x364F6FFA464EE52EULL,
+	0xD60F6DCEDC314222ULL, 0x56963B0DCA418FC0ULL, 0x16F50EDF91E513AFULL, 0xEF1955914B609F93ULL,
+	0x565601C0364E3228ULL, 0xECB53939887E8175ULL, 0xBAC7A9A18531294BULL, 0xB344C470397BBA52ULL,
+	0x65D34954DAF3CEBDULL, 0xB4B81B3FA97511E2ULL, 0xB422061193D6F6A7ULL, 0x071582401C38434DULL,
+	0x7A13F18BBEDC4FF5ULL, 0xBC4097B116C524D2ULL, 0x59B97885E2F2EA28ULL, 0x99170A5DC3115544ULL,
+	0x6F423357E7C6A9F9ULL, 0x325928EE6E6F8794ULL, 0xD0E4366228B03343ULL, 0x565C31F7DE89EA27ULL,
+	0x30F5611484119414ULL, 0xD873DB391292ED4FULL, 0x7BD94E1D8E17DEBCULL, 0xC7D9F16864A76E94ULL,
+	0x947AE053EE56E63CULL, 0xC8C93882F9475F5FULL, 0x3A9BF55BA91F81CAULL, 0xD9A11FBB3D9808E4ULL,
+	0x0FD22063EDC29FCAULL, 0xB3F256D8ACA0B0B9ULL, 0xB03031A8B4516E84ULL, 0x35DD37D5871448AFULL,
+	0xE9F6082B05542E4EULL, 0xEBFAFA33D7254B59ULL, 0x9255ABB50D532280ULL, 0xB9AB4CE57F2D34F3ULL,
+	0x693501D628297551ULL, 0xC62C58F97DD949BFULL, 0xCD454F8F19C5126AULL, 0xBBE83F4ECC2BDECBULL,
+	0xDC842B7E2819E230ULL, 0xBA89142E007503B8ULL, 0xA3BC941D0A5061CBULL, 0xE9F6760E32CD8021ULL,
+	0x09C7E552BC76492FULL, 0x852F54934DA55CC9ULL, 0x8107FCCF064FCF56ULL, 0x098954D51FFF6580ULL,
+	0x23B70EDB1955C4BFULL, 0xC330DE426430F69DULL, 0x4715ED43E8A45C0AULL, 0xA8D7E4DAB780A08DULL,
+	0x0572B974F03CE0BBULL, 0xB57D2E985E1419C7ULL, 0xE8D9ECBE2CF3D73FULL, 0x2FE4B17170E59750ULL,
+	0x11317BA87905E790ULL, 0x7FBF21EC8A1F45ECULL, 0x1725CABFCB045B00ULL, 0x964E915CD5E2B207ULL,
+	0x3E2B8BCBF016D66DULL, 0xBE7444E39328A0ACULL, 0xF85B2B4FBCDE44B7ULL, 0x49353FEA39BA63B1ULL,
+	0x1DD01AAFCD53486AULL, 0x1FCA8A92FD719F85ULL, 0xFC7C95D827357AFAULL, 0x18A6A990C8B35EBDULL,
+	0xCCCB7005C6B9C28DULL, 0x3BDBB92C43B17F26ULL, 0xAA70B5B4F89695A2ULL, 0xE94C39A54A98307FULL,
+	0xB7A0B174CFF6F36EULL, 0xD4DBA84729AF48ADULL, 0x2E18BC1AD9704A68ULL, 0x2DE0966DAF2F8B1CULL,
+	0xB9C11D5B1E43A07EULL, 0x64972D68DEE33360ULL, 0x94628D38D0C20584ULL, 0xDBC0D2B6AB90A559ULL,
+	0xD2733C4335C6A72FULL, 0x7E75D99D94A70F4DULL, 0x6CED1983376FA72BULL, 0x97FCAACBF030BC24ULL,
+	0x7B77497B32503B12ULL, 0x8547EDDFB81CCB94ULL, 0x79999CDFF70902CBULL, 0xCFFE1939438E9B24ULL,
+	0x829626E3892D95D7ULL, 0x92FAE24291F2B3F1ULL, 0x63E22C147B9C3403ULL, 0xC678B6D860284A1CULL,
+	0x5873888850659AE7ULL, 0x0981DCD296A8736DULL, 0x9F65789A6509A440ULL, 0x9FF38FED72E9052FULL,
+	0xE479EE5B9930578CULL, 0xE7F28ECD2D49EECDULL, 0x56C074A581EA17FEULL, 0x5544F7D774B14AEFULL,
+	0x7B3F0195FC6F290FULL, 0x12153635B2C0CF57ULL, 0x7F5126DBBA5E0CA7ULL, 0x7A76956C3EAFB413ULL,
+	0x3D5774A11D31AB39ULL, 0x8A1B083821F40CB4ULL, 0x7B4A38E32537DF62ULL, 0x950113646D1D6E03ULL,
+	0x4DA8979A0041E8A9ULL, 0x3BC36E078F7515D7ULL, 0x5D0A12F27AD310D1ULL, 0x7F9D1A2E1EBE1327ULL,
+	0xDA3A361B1C5157B1ULL, 0xDCDD7D20903D0C25ULL, 0x36833336D068F707ULL, 0xCE68341F79893389ULL,
+	0xAB9090168DD05F34ULL, 0x43954B3252DC25E5ULL, 0xB438C2B67F98E5E9ULL, 0x10DCD78E3851A492ULL,
+	0xDBC27AB5447822BFULL, 0x9B3CDB65F82CA382ULL, 0xB67B7896167B4C84ULL, 0xBFCED1B0048EAC50ULL,
+	0xA9119B60369FFEBDULL, 0x1FFF7AC80904BF45ULL, 0xAC12FB171817EEE7ULL, 0xAF08DA9177DDA93DULL,
+	0x1B0CAB936E65C744ULL, 0xB559EB1D04E5E932ULL, 0xC37B45B3F8D6F2BAULL, 0xC3A9DC228CAAC9E9ULL,
+	0xF3B8B6675A6507FFULL, 0x9FC477DE4ED681DAULL, 0x67378D8ECCEF96CBULL, 0x6DD856D94D259236ULL,
+	0xA319CE15B0B4DB31ULL, 0x073973751F12DD5EULL, 0x8A8E849EB32781A5ULL, 0xE1925C71285279F5ULL,
+	0x74C04BF1790C0EFEULL, 0x4DDA48153C94938AULL, 0x9D266D6A1CC0542CULL, 0x7440FB816508C4FEULL,
+	0x13328503DF48229FULL, 0xD6BF7BAEE43CAC40ULL, 0x4838D65F6EF6748FULL, 0x1E152328F3318DEAULL,
+	0x8F8419A348F296BFULL, 0x72C8834A5957B511ULL, 0xD7A023A73260B45CULL, 0x94EBC8ABCFB56DAEULL,
+	0x9FC10D0F989993E0ULL, 0xDE68A2355B93CAE6ULL, 0xA44CFE79AE538BBEULL, 0x9D1D84FCCE371425ULL,
+	0x51D2B1AB2DDFB636ULL, 0x2FD7E4B9E72CD38CULL, 0x65CA5B96B7552210ULL, 0xDD69A0D8AB3B546DULL,
+	0x604D51B25FBF70E2ULL, 0x73AA8A564FB7AC9EULL, 0x1A8C1E992B941148ULL, 0xAAC40A2703D9BEA0ULL,
+	0x764DBEAE7FA4F3A6ULL, 0x1E99B96E70A9BE8BULL, 0x2C5E9DEB57EF4743ULL, 0x3A938FEE32D29981ULL,
+	0x26E6DB8FFDF5ADFEULL, 0x469356C504EC9F9DULL, 0xC8763C5B08D1908CULL, 0x3F6C6AF859D80055ULL,
+	0x7F7CC39420A3A545ULL, 0x9BFB227EBDF4C5CEULL, 0x89039D79D6FC5C5CULL, 0x8FE88B57305E2AB6ULL,
+	0xA09E8C8C35AB96DEULL, 0xFA7E393983325753ULL, 0xD6B6D0ECC617C699ULL, 0xDFEA21EA9E7557E3ULL,
+	0xB67C1FA481680AF8ULL, 0xCA1E3785A9E724E5ULL, 0x1CFC8BED0D681639ULL, 0xD18D8549D140CAEAULL,
+	0x4ED0FE7E9DC91335ULL, 0xE4DBF0634473F5D2ULL, 0x1761F93A44D5AEFEULL, 0x53898E4C3910DA55ULL,
+	0x734DE8181F6EC39AULL, 0x2680B122BAA28D97ULL, 0x298AF231C85BAFABULL, 0x7983EED3740847D5ULL,
+	0x66C1A2A1A60CD889ULL, 0x9E17E49642A3E4C1ULL, 0xEDB454E7BADC0805ULL, 0x50B704CAB602C329ULL,
+	0x4CC317FB9CDDD023ULL, 0x66B4835D9EAFEA22ULL, 0x219B97E26FFC81BDULL, 0x261E4E4C0A333A9DULL,
+	0x1FE2CCA76517DB90ULL, 0xD7504DFA8816EDBBULL, 0xB9571FA04DC089C8ULL, 0x1DDC0325259B27DEULL,
+	0xCF3F4688801EB9AAULL, 0xF4F5D05C10CAB243ULL, 0x38B6525C21A42B0EULL, 0x36F60E2BA4FA6800ULL,
+	0xEB3593803173E0CEULL, 0x9C4CD6257C5A3603ULL, 0xAF0C317D32ADAA8AULL, 0x258E5A80C7204C4BULL,
+	0x8B889D624D44885DULL, 0xF4D14597E660F855ULL, 0xD4347F66EC8941C3ULL, 0xE699ED85B0DFB40DULL,
+	0x2472F6207C2D0484ULL, 0xC2A1E7B5B459AEB5ULL, 0xAB4F6451CC1D45ECULL, 0x63767572AE3D6174ULL,
+	0xA59E0BD101731A28ULL, 0x116D0016CB948F09ULL, 0x2CF9C8CA052F6E9FULL, 0x0B090A7560A968E3ULL,
+	0xABEEDDB2DDE06FF1ULL, 0x58EFC10B06A2068DULL, 0xC6E57A78FBD986E0ULL, 0x2EAB8CA63CE802D7ULL,
+	0x14A195640116F336ULL, 0x7C0828DD624EC390ULL, 0xD74BBE77E6116AC7ULL, 0x804456AF10F5FB53ULL,
+	0xEBE9EA2ADF4321C7ULL, 0x03219A39EE587A30ULL, 0x49787FEF17AF9924ULL, 0xA1E9300CD8520548ULL,
+	0x5B45E522E4B1B4EFULL, 0xB49C3B3995091A36ULL, 0xD4490AD526F14431ULL, 0x12A8F216AF9418C2ULL,
+	0x001F837CC7350524ULL, 0x1877B51E57A764D5ULL, 0xA2853B80F17F58EEULL, 0x993E1DE72D36D310ULL,
+	0xB3598080CE64A656ULL, 0x252F59CF0D9F04BBULL, 0xD23C8E176D113600ULL, 0x1BDA0492E7E4586EULL,
+	0x21E0BD5026C619BFULL, 0x3B097ADAF088F94EULL, 0x8D14DEDB30BE846EULL, 0xF95CFFA23AF5F6F4ULL,
+	0x3871700761B3F743ULL, 0xCA672B91E9E4FA16ULL, 0x64C8E531BFF53B55ULL, 0x241260ED4AD1E87DULL,
+	0x106C09B972D2E822ULL, 0x7FBA195410E5CA30ULL, 0x7884D9BC6CB569D8ULL, 0x0647DFEDCD894A29ULL,
+	0x63573FF03E224774ULL, 0x4FC8E9560F91B123ULL, 0x1DB956E450275779ULL, 0xB8D91274B9E9D4FBULL,
+	0xA2EBEE47E2FBFCE1ULL, 0xD9F1F30CCD97FB09ULL, 0xEFED53D75FD64E6BULL, 0x2E6D02C36017F67FULL,
+	0xA9AA4D20DB084E9BULL, 0xB64BE8D8B25396C1ULL, 0x70CB6AF7C2D5BCF0ULL, 0x98F076A4F7A2322EULL,
+	0xBF84470805E69B5FULL, 0x94C3251F06F90CF3ULL, 0x3E003E616A6591E9ULL, 0xB925A6CD0421AFF3ULL,
+	0x61BDD1307C66E300ULL, 0xBF8D5108E27E0D48ULL, 0x240AB57A8B888B20ULL, 0xFC87614BAF287E07ULL,
+	0xEF02CDD06FFDB432ULL, 0xA1082C0466DF6C0AULL, 0x8215E577001332C8ULL, 0xD39BB9C3A48DB6CFULL,
+	0x2738259634305C14ULL, 0x61CF4F94C97DF93DULL, 0x1B6BACA2AE4E125BULL, 0x758F450C88572E0BULL,
+	0x959F587D507A8359ULL, 0xB063E962E045F54DULL, 0x60E8ED72C0DFF5D1ULL, 0x7B64978555326F9FULL,
+	0xFD080D236DA814BAULL, 0x8C90FD9B083F4558ULL, 0x106F72FE81E2C590ULL, 0x7976033A39F7D952ULL,
+	0xA4EC0132764CA04BULL, 0x733EA705FAE4FA77ULL, 0xB4D8F77BC3E56167ULL, 0x9E21F4F903B33FD9ULL,
+	0x9D765E419FB69F6DULL, 0xD30C088BA61EA5EFULL, 0x5D94337FBFAF7F5BULL, 0x1A4E4822EB4D7A59ULL,
+	0x6FFE73E81B637FB3ULL, 0xDDF957BC36D8B9CAULL, 0x64D0E29EEA8838B3ULL, 0x08DD9BDFD96B9F63ULL,
+	0x087E79E5A57D1D13ULL, 0xE328E230E3E2B3FBULL, 0x1C2559E30F0946BEULL, 0x720BF5F26F4D2EAAULL,
+	0xB0774D261CC609DBULL, 0x443F64EC5A371195ULL, 0x4112CF68649A260EULL, 0xD813F2FAB7F5C5CAULL,
+	0x660D3257380841EEULL, 0x59AC2C7873F910A3ULL, 0xE846963877671A17ULL, 0x93B633ABFA3469F8ULL,
+	0xC0C0F5A60EF4CDCFULL, 0xCAF21ECD4377B28CULL, 0x57277707199B8175ULL, 0x506C11B9D90E8B1DULL,
+	0xD83CC2687A19255FULL, 0x4A29C6465A314CD1ULL, 0xED2DF21216235097ULL, 0xB5635C95FF7296E2ULL,
+	0x22AF003AB672E811ULL, 0x52E762596BF68235ULL, 0x9AEBA33AC6ECC6B0ULL, 0x944F6DE09134DFB6ULL,
+	0x6C47BEC883A7DE39ULL, 0x6AD047C430A12104ULL, 0xA5B1CFDBA0AB4067ULL, 0x7C45D833AFF07862ULL,
+	0x5092EF950A16DA0BULL, 0x9338E69C052B8E7BULL, 0x455A4B4CFE30E3F5ULL, 0x6B02E63195AD0CF8ULL,
+	0x6B17B224BAD6BF27ULL, 0xD1E0CCD25BB9C169ULL, 0xDE0C89A556B9AE70ULL, 0x50065E535A213CF6ULL,
+	0x9C1169FA2777B874ULL, 0x78EDEFD694AF1EEDULL, 0x6DC93D9526A50E68ULL, 0xEE97F453F06791EDULL,
+	0x32AB0EDB696703D3ULL, 0x3A6853C7E70757A7ULL, 0x31865CED6120F37DULL, 0x67FEF95D92607890ULL,
+	0x1F2B1D1F15F6DC9CULL, 0xB69E38A8965C6B65ULL, 0xAA9119FF184CCCF4ULL, 0xF43C732873F24C13ULL,
+	0xFB4A3D794A9A80D2ULL, 0x3550C2321FD6109CULL, 0x371F77E76BB8417EULL, 0x6BFA9AAE5EC05779ULL,
+	0xCD04F3FF001A4778ULL, 0xE3273522064480CAULL, 0x9F91508BFFCFC14AULL, 0x049A7F41061A9E60ULL,
+	0xFCB6BE43A9F2FE9BULL, 0x08DE8A1C7797DA9BULL, 0x8F9887E6078735A1ULL, 0xB5B4071DBFC73A66ULL,
+	0x230E343DFBA08D33ULL, 0x43ED7F5A0FAE657DULL, 0x3A88A0FBBCB05C63ULL, 0x21874B8B4D2DBC4FULL,
+	0x1BDEA12E35F6A8C9ULL, 0x53C065C6C8E63528ULL, 0xE34A1D250E7A8D6BULL, 0xD6B04D3B7651DD7EULL,
+	0x5E90277E7CB39E2DULL, 0x2C046F22062DC67DULL, 0xB10BB459132D0A26ULL, 0x3FA9DDFB67E2F199ULL,
+	0x0E09B88E1914F7AFULL, 0x10E8B35AF3EEAB37ULL, 0x9EEDECA8E272B933ULL, 0xD4C718BC4AE8AE5FULL,
+	0x81536D601170FC20ULL, 0x91B534F885818A06ULL, 0xEC8177F83F900978ULL, 0x190E714FADA5156EULL,
+	0xB592BF39B0364963ULL, 0x89C350C893AE7DC1ULL, 0xAC042E70F8B383F2ULL, 0xB49B52E587A1EE60ULL,
+	0xFB152FE3FF26DA89ULL, 0x3E666E6F69AE2C15ULL, 0x3B544EBE544C19F9ULL, 0xE805A1E290CF2456ULL,
+	0x24B33C9D7ED25117ULL, 0xE74733427B72F0C1ULL, 0x0A804D18B7097475ULL, 0x57E3306D881EDB4FULL,
+	0x4AE7D6A36EB5DBCBULL, 0x2D8D5432157064C8ULL, 0xD1E649DE1E7F268BULL, 0x8A328A1CEDFE552CULL,
+	0x07A3AEC79624C7DAULL, 0x84547DDC3E203C94ULL, 0x990A98FD5071D263ULL, 0x1A4FF12616EEFC89ULL,
+	0xF6F7FD1431714200ULL, 0x30C05B1BA332F41CULL, 0x8D2636B81555A786ULL, 0x46C9FEB55D120902ULL,
+	0xCCEC0A73B49C9921ULL, 0x4E9D2827355FC492ULL, 0x19EBB029435DCB0FULL, 0x4659D2B743848A2CULL,
+	0x963EF2C96B33BE31ULL, 0x74F85198B05A2E7DULL, 0x5A0F544DD2B1FB18ULL, 0x03727073C2E134B1ULL,
+	0xC7F6AA2DE59AEA61ULL, 0x352787BAA0D7C22FULL, 0x9853EAB63B5E0B35ULL, 0xABBDCDD7ED5C0860ULL,
+	0xCF05DAF5AC8D77B0ULL, 0x49CAD48CEBF4A71EULL, 0x7A4C10EC2158C4A6ULL, 0xD9E92AA246BF719EULL,
+	0x13AE978D09FE5557ULL, 0x730499AF921549FFULL, 0x4E4B705B92903BA4ULL, 0xFF577222C14F0A3AULL,
+	0x55B6344CF97AAFAEULL, 0xB862225B055B6960ULL, 0xCAC09AFBDDD2CDB4ULL, 0xDAF8E9829FE96B5FULL,
+	0xB5FDFC5D3132C498ULL, 0x310CB380DB6F7503ULL, 0xE87FBB46217A360EULL, 0x2102AE466EBB1148ULL,
+	0xF8549E1A3AA5E00DULL, 0x07A69AFDCC42261AULL, 0xC4C118BFE78FEAAEULL, 0xF9F4892ED96BD438ULL,
+	0x1AF3DBE25D8F45DAULL, 0xF5B4B0B0D2DEEEB4ULL, 0x962ACEEFA82E1C84ULL, 0x046E3ECAAF453CE9ULL,
+	0xF05D129681949A4CULL, 0x964781CE734B3C84ULL, 0x9C2ED44081CE5FBDULL, 0x522E23F3925E319EULL,
+	0x177E00F9FC32F791ULL, 0x2BC60A63A6F3B3F2ULL, 0x222BBFAE61725606ULL, 0x486289DDCC3D6780ULL,
+	0x7DC7785B8EFDFC80ULL, 0x8AF38731C02BA980ULL, 0x1FAB64EA29A2DDF7ULL, 0xE4D9429322CD065AULL,
+	0x9DA058C67844F20CULL, 0x24C0E332B70019B0ULL, 0x233003B5A6CFE6ADULL, 0xD586BD01C5C217F6ULL,
+	0x5E5637885F29BC2BULL, 0x7EBA726D8C94094BULL, 0x0A56A5F0BFE39272ULL, 0xD79476A84EE20D06ULL,
+	0x9E4C1269BAA4BF37ULL, 0x17EFEE45B0DEE640ULL, 0x1D95B0A5FCF90BC6ULL, 0x93CBE0B699C2585DULL,
+	0x65FA4F227A2B6D79ULL, 0xD5F9E858292504D5ULL, 0xC2B5A03F71471A6FULL, 0x59300222B4561E00ULL,
+	0xCE2F8642CA0712DCULL, 0x7CA9723FBB2E8988ULL, 0x2785338347F2BA08ULL, 0xC61BB3A141E50E8CULL,
+	0x150F361DAB9DEC26ULL, 0x9F6A419D382595F4ULL, 0x64A53DC924FE7AC9ULL, 0x142DE49FFF7A7C3DULL,
+	0x0C335248857FA9E7ULL, 0x0A9C32D5EAE45305ULL, 0xE6C42178C4BBB92EULL, 0x71F1CE2490D20B07ULL,
+	0xF1BCC3D275AFE51AULL, 0xE728E8C83C334074ULL, 0x96FBF83A12884624ULL, 0x81A1549FD6573DA5ULL,
+	0x5FA7867CAF35E149ULL, 0x56986E2EF3ED091BULL, 0x917F1DD5F8886C61ULL, 0xD20D8C88C8FFE65FULL,
+	0x31D71DCE64B2C310ULL, 0xF165B587DF898190ULL, 0xA57E6339DD2CF3A0ULL, 0x1EF6E6DBB1961EC9ULL,
+	0x70CC73D90BC26E24ULL, 0xE21A6B35DF0C3AD7ULL, 0x003A93D8B2806962ULL, 0x1C99DED33CB890A1ULL,
+	0xCF3145DE0ADD4289ULL, 0xD0E4427A5514FB72ULL, 0x77C621CC9FB3A483ULL, 0x67A34DAC4356550BULL,
+	0xF8D626AAAF278509ULL
+};
+
 // castling rights update constants
 const int castlingRights[64] = {
      7, 15, 15, 15,  3, 15, 15, 11,
@@ -304,10 +874,15 @@ const int castlingRights[64] = {
     13, 15, 15, 15, 12, 15, 15, 14
 };
 
-const uint64_t NOT_A_FILE = 18374403900871474942ULL;
-const uint64_t NOT_H_FILE = 9187201950435737471ULL;
-const uint64_t NOT_GH_FILE = 4557430888798830399ULL;
-const uint64_t NOT_AB_FILE = 18229723555195321596ULL;
+constexpr uint64_t NOT_A_FILE = 18374403900871474942ULL;
+constexpr uint64_t NOT_H_FILE = 9187201950435737471ULL;
+constexpr uint64_t NOT_GH_FILE = 4557430888798830399ULL;
+constexpr uint64_t NOT_AB_FILE = 18229723555195321596ULL;
+
+constexpr uint64_t RANK_8 = 0x00000000000000FFULL;
+constexpr uint64_t RANK_6 = 0x0000000000FF0000ULL;
+constexpr uint64_t RANK_3 = 0x0000FF0000000000ULL;
+constexpr uint64_t RANK_1 = 0xFF00000000000000ULL;
 
 int materialScore[12] = {
     100,      // white pawn score
@@ -398,6 +973,8 @@ const int kingScore[64] =
 	 20, 30, 10,  0,  0, 10, 30, 20
 };
 
+const int *pieceSquareScore[6] = { pawnScore, knightScore, bishopScore, rookScore, queenScore, kingScore };
+
 const int mirrorScore[64] =
 {
 	a1, b1, c1, d1, e1, f1, g1, h1,
@@ -410,7 +987,21 @@ const int mirrorScore[64] =
 	a8, b8, c8, d8, e8, f8, g8, h8
 };
 
-static int MVV_LVA[12][12] = {
+// mobility counts reachable squares not held by own pieces or covered by enemy pawns,
+// centred on a typical count for each piece kind
+const int mobilityBase[6] = { 0, 4, 7, 7, 14, 0 };
+const int mobilityWeight[6] = { 0, 4, 3, 2, 1, 0 };
+
+// king attack units of each piece kind that reaches the enemy king zone, and the percentage
+// of the units that counts by the number of attackers, one attacker alone is no threat
+const int kingAttackWeight[6] = { 0, 20, 20, 40, 80, 0 };
+const int kingAttackShare[8] = { 0, 0, 50, 75, 88, 94, 97, 99 };
+
+// penalty for each knight, bishop, rook or queen that an enemy pawn attacks, a king in pawn check is not a threat
+const int pawnThreat = 20;
+
+// capture order by [attacker][victim], most valuable victim first, then least valuable attacker
+const int MVV_LVA[12][12] = {
  	105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
 	104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
 	103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
@@ -437,26 +1028,109 @@ const string notation[] = {
     "a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1",
 };
 
-char *startPosition = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 ";
-char *trickyPosition = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1 ";
-char *killerPosition = "rnbqkb1r/pp1p1pPp/8/2p1pP2/1P1P4/3P3P/P1P1P3/RNBQKBNR w KQkq e6 0 1";
+const char *startPosition = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 ";
+const char *trickyPosition = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1 ";
+const char *killerPosition = "rnbqkb1r/pp1p1pPp/8/2p1pP2/1P1P4/3P3P/P1P1P3/RNBQKBNR w KQkq e6 0 1";
+
+// bench positions: openings, middlegames, endgames, tablebase-sized endings and mates
+const char *benchPositions[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+	"4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+	"rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+	"r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+	"r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+	"r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+	"r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+	"4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+	"2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+	"r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+	"3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+	"r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+	"4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+	"3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+	"6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/8 b - - 3 54",
+	"3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+	"2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+	"8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+	"7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+	"8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+	"8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+	"8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+	"8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+	"5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+	"6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+	"1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+	"6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+	"8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+	"5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+	"4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+	"r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+	"3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+	"4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+	"rnbqkb1r/pp1p1pPp/8/2p1pP2/1P1P4/3P3P/P1P1P3/RNBQKBNR w KQkq e6 0 1",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+	"8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+	"8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+	"8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+	"8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+	"8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+	"8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+	"8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+	"6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+	"r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+	"8/8/8/8/8/6k1/6p1/6K1 w - - 0 1",
+	"7k/7P/6K1/8/3B4/8/8/8 b - - 0 1",
+	NULL
+};
+
+// the engine bound to the calling thread, see BindEngine
+thread_local Position *pos;
+thread_local Undo *undo;
+thread_local SearchStack *ss;
+thread_local SearchInfo *sInfo;
+thread_local HashTable *hashTable;
+thread_local EvalCache *evalCache;
+
+#ifdef SEARCH_STATS
+thread_local SearchStats *stats;
+#endif
+
+// the engine driven by the UCI loop and the command line
+Engine uciEngine[1];
+
+// lines read while searching that belong to the next command
+string pendingInput;
 
-uint64_t zobrist[12][64];
-uint64_t castleKeys[16];
-uint64_t epKeys[64];
-uint64_t sideKey;
+PolyglotBook book[1];
 
-uint64_t pawnAttacks[2][64];
-uint64_t knightAttacks[64];
-uint64_t kingAttacks[64];
-uint64_t rookMasks[64];
-uint64_t bishopMasks[64];
-uint64_t rookAttacks[64][4096];
-uint64_t bishopAttacks[64][512];
+Tablebases syzygy[1];
 
-Undo undo[1];
-Position pos[1];
-SearchInfo sInfo[1];
+int tbBinomial[6][64];
+int tbLeadPawnIdx[6][64];
+int tbLeadPawnsSize[6][4];
+int tbMapPawns[64];
+int tbMapB1H1H7[64];
+int tbMapA1D1D4[64];
+int tbMapKK[10][64];
+
+// points the calling thread at an engine, one thread may switch between many engines
+void BindEngine(Engine *engine)
+{
+	pos = engine->pos;
+	undo = engine->undo;
+	ss = engine->ss;
+	sInfo = engine->sInfo;
+	hashTable = engine->hashTable;
+	evalCache = engine->evalCache;
+
+#ifdef SEARCH_STATS
+	stats = engine->stats;
+#endif
+}
 
 int getTimeMS()
 {
@@ -465,6 +1139,80 @@ int getTimeMS()
     return time_value.tv_sec * 1000 + time_value.tv_usec / 1000;
 }
 
+#ifdef SEARCH_STATS
+static inline uint64_t StatClock()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+bool InputWaiting(int timeoutMs = 0)
+{
+	fd_set readfds;
+	struct timeval tv;
+
+	FD_ZERO(&readfds);
+	FD_SET(fileno(stdin), &readfds);
+
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = timeoutMs % 1000 * 1000;
+
+	select(16, &readfds, 0, 0, &tv);
+
+	return FD_ISSET(fileno(stdin), &readfds);
+}
+
+// poll the GUI while searching, other commands are queued for after the search
+void ReadInput()
+{
+	string line;
+	char c;
+
+	if (sInfo->quit || !InputWaiting())
+		return;
+
+	while (read(fileno(stdin), &c, 1) == 1)
+	{
+		line += c;
+
+		if (c == '\n')
+			break;
+	}
+
+	// end of input, finish the search and leave
+	if (line.empty())
+		sInfo->quit = 1;
+	else if (!strncmp(line.c_str(), "quit", 4))
+	{
+		sInfo->quit = 1;
+		sInfo->stopped = 1;
+	}
+	else if (!strncmp(line.c_str(), "stop", 4))
+		sInfo->stopped = 1;
+	else if (!strncmp(line.c_str(), "ponderhit", 9) && sInfo->ponder)
+	{
+		// the expected move was played, the clock starts now and the search goes on as it is
+		sInfo->ponder = 0;
+		sInfo->stoptime += getTimeMS() - sInfo->starttime;
+	}
+	else if (!strncmp(line.c_str(), "isready", 7))
+		cout << "readyok" << endl;
+	else
+		pendingInput += line;
+}
+
+static inline void CheckUp()
+{
+	if (sInfo->timeset && !sInfo->ponder && getTimeMS() > sInfo->stoptime)
+		sInfo->stopped = 1;
+
+	if (sInfo->stopRequest)
+		sInfo->stopped = 1;
+
+	if (sInfo->uci)
+		ReadInput();
+}
+
 void PrintBitboard(uint64_t bb)
 {
 	for (int sq = 0; sq < 64; sq++)
@@ -476,26 +1224,97 @@ void PrintBitboard(uint64_t bb)
 	cout << endl << endl;
 }
 
+static inline char *WriteNumber(char *out, int value)
+{
+	char digits[12];
+	int count = 0;
+
+	do
+		digits[count++] = '0' + value % 10;
+	while (value /= 10);
+
+	while (count)
+		*out++ = digits[--count];
+
+	return out;
+}
+
+// writes all six FEN fields, buffer needs MAX_FEN_LENGTH bytes, returns the length
+int WriteFen(Position *pos, char *buffer)
+{
+	char *out = buffer;
+
+	for (int rank = 0; rank < 8; rank++)
+	{
+		int empty = 0;
+
+		for (int square = rank * 8; square < rank * 8 + 8; square++)
+		{
+			int piece = pos->mailbox[square];
+
+			if (piece == NO_PIECE)
+			{
+				empty++;
+				continue;
+			}
+
+			if (empty)
+				*out++ = '0' + empty;
+
+			*out++ = pieceChars[piece];
+			empty = 0;
+		}
+
+		if (empty)
+			*out++ = '0' + empty;
+
+		if (rank < 7)
+			*out++ = '/';
+	}
+
+	*out++ = ' ';
+	*out++ = pos->side == WHITE ? 'w' : 'b';
+	*out++ = ' ';
+
+	if (!pos->ca)
+		*out++ = '-';
+
+	for (int i = 0; i < 4; i++)
+		if (pos->ca & (1 << i))
+			*out++ = "KQkq"[i];
+
+	*out++ = ' ';
+
+	if (pos->ep == noSq)
+		*out++ = '-';
+	else
+	{
+		*out++ = 'a' + pos->ep % 8;
+		*out++ = '8' - pos->ep / 8;
+	}
+
+	*out++ = ' ';
+	out = WriteNumber(out, pos->fifty);
+	*out++ = ' ';
+	out = WriteNumber(out, pos->fullmove);
+	*out = '\0';
+
+	return out - buffer;
+}
+
 void PrintBoard(Position *pos)
 {
+	char fen[MAX_FEN_LENGTH];
+
 	for (int i = 0; i < 64; i++)
 	{
 		if (i % 8 == 0)
 			cout << endl << 8 - (i / 8) << " ";
-		
-		if (getBit(pos->bb[P], i)) cout << unicodePieces[P] << " ";
-		else if (getBit(pos->bb[p], i)) cout << unicodePieces[p] << " ";
-		else if (getBit(pos->bb[N], i)) cout << unicodePieces[N] << " ";
-		else if (getBit(pos->bb[n], i)) cout << unicodePieces[n] << " ";
-		else if (getBit(pos->bb[B], i)) cout << unicodePieces[B] << " ";
-		else if (getBit(pos->bb[b], i)) cout << unicodePieces[b] << " ";
-		else if (getBit(pos->bb[R], i)) cout << unicodePieces[R] << " ";
-		else if (getBit(pos->bb[r], i)) cout << unicodePieces[r] << " ";
-		else if (getBit(pos->bb[Q], i)) cout << unicodePieces[Q] << " ";
-		else if (getBit(pos->bb[q], i)) cout << unicodePieces[q] << " ";
-		else if (getBit(pos->bb[K], i)) cout << unicodePieces[K] << " ";
-		else if (getBit(pos->bb[k], i)) cout << unicodePieces[k] << " ";
-		else cout << ". ";
+
+		if (pos->mailbox[i] == NO_PIECE)
+			cout << ". ";
+		else
+			cout << unicodePieces[pos->mailbox[i]] << " ";
 	}
 
 	cout << endl << "  a b c d e f g h" << endl;
@@ -504,49 +1323,64 @@ void PrintBoard(Position *pos)
 	cout << "Enpassant: " << ((pos->ep != noSq) ? notation[pos->ep] : "no") << endl;
 	cout << "Castling: " << ((pos->ca & WK) ? 'K' : '-') << ((pos->ca & WQ) ? 'Q' : '-')
 		 << ((pos->ca & BK) ? 'k' : '-') << ((pos->ca & BQ) ? 'q' : '-') << endl;
-	cout << "Hash Key: " << (uint64_t)pos->hashKey << "ULL" << endl << endl;
+	cout << "Fifty: " << pos->fifty << " Move: " << pos->fullmove << endl;
+	cout << "Hash Key: " << (uint64_t)pos->hashKey << "ULL" << endl;
+
+	WriteFen(pos, fen);
+	cout << "Fen: " << fen << endl << endl;
 }
 
-static inline int CountBits(uint64_t bb)
+string MoveString(int move)
 {
-	int count = 0;
-	
-	while (bb)
-	{
-		bb &= bb - 1;
-		count++;
-	}
-	
-	return count;
+	string str = notation[getSource(move)] + notation[getTarget(move)];
+
+	if (getPromotion(move))
+		str += "nbrq"[getFlag(move) & 3];
+
+	return str;
+}
+
+void PrintMove(int move)
+{
+	cout << MoveString(move);
 }
 
-static inline int GetLSB(uint64_t bb)
+// the builtin is a popcnt instruction when the target has one, see the Makefile
+static constexpr int CountBits(uint64_t bb)
+{
+	return __builtin_popcountll(bb);
+}
+
+// a single bit-scan instruction, the builtin also folds in the constexpr table setup
+static constexpr int GetLSB(uint64_t bb)
 {
 	if (bb)
-		return CountBits((bb & -bb) - 1);
+		return __builtin_ctzll(bb);
 	else
 		return -1;
 }
 
-uint64_t SetOccupancy(int index, int bitsInMask, uint64_t attackMask)
+static inline uint64_t ReadBigEndian(const unsigned char *data, int bytes)
 {
-	uint64_t occupancy = 0ULL;
+	uint64_t value = 0;
 
-	int square = 0;
+	for (int i = 0; i < bytes; i++)
+		value = (value << 8) | data[i];
 
-	for (int count = 0; count < bitsInMask; count++)
-	{
-		square = GetLSB(attackMask);
-		popBit(attackMask, square);
+	return value;
+}
 
-		if (index & (1 << count))
-			occupancy |= (1ULL << square);
-	}
+static inline uint64_t ReadLittleEndian(const unsigned char *data, int bytes)
+{
+	uint64_t value = 0;
 
-	return occupancy;
+	for (int i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | data[i];
+
+	return value;
 }
 
-uint64_t MaskPawnAttacks(int side, int square)
+constexpr uint64_t MaskPawnAttacks(int side, int square)
 {
 	uint64_t attacks = 0ULL;
 	uint64_t bitboard = 0ULL;
@@ -566,7 +1400,7 @@ uint64_t MaskPawnAttacks(int side, int square)
 	
 	return attacks;
 }
-uint64_t MaskKnightAttacks(int sqr)
+constexpr uint64_t MaskKnightAttacks(int sqr)
 {
 	uint64_t bitboard = 0ULL;
 	uint64_t attacks = 0ULL;
@@ -585,7 +1419,7 @@ uint64_t MaskKnightAttacks(int sqr)
 	return attacks;
 }
 
-uint64_t MaskKingAttacks(int sqr)
+constexpr uint64_t MaskKingAttacks(int sqr)
 {
 	uint64_t bitboard = 0ULL;
 	uint64_t attacks = 0ULL;
@@ -604,11 +1438,11 @@ uint64_t MaskKingAttacks(int sqr)
 	return attacks;
 }
 
-uint64_t MaskBishopAttacks(int sqr)
+constexpr uint64_t MaskBishopAttacks(int sqr)
 {
 	uint64_t attacks = 0ULL;
 
-	int r, f;
+	int r = 0, f = 0;
 
 	int tr = sqr / 8;
 	int tf = sqr % 8;
@@ -621,11 +1455,11 @@ uint64_t MaskBishopAttacks(int sqr)
 	return attacks;
 }
 
-uint64_t MaskRookAttacks(int sqr)
+constexpr uint64_t MaskRookAttacks(int sqr)
 {
 	uint64_t attacks = 0ULL;
 
-	int r, f;
+	int r = 0, f = 0;
 
 	int tr = sqr / 8;
 	int tf = sqr % 8;
@@ -638,11 +1472,11 @@ uint64_t MaskRookAttacks(int sqr)
 	return attacks;
 }
 
-uint64_t BishopAttacksOTF(int sqr, uint64_t blockers)
+constexpr uint64_t BishopAttacksOTF(int sqr, uint64_t blockers)
 {
 	uint64_t attacks = 0ULL;
 
-	int r, f;
+	int r = 0, f = 0;
 
 	int tr = sqr / 8;
 	int tf = sqr % 8;
@@ -671,11 +1505,11 @@ uint64_t BishopAttacksOTF(int sqr, uint64_t blockers)
 	return attacks;
 }
 
-uint64_t RookAttacksOTF(int square, uint64_t blockers)
+constexpr uint64_t RookAttacksOTF(int square, uint64_t blockers)
 {
 	uint64_t attacks = 0ULL;
 
-	int r, f;
+	int r = 0, f = 0;
 
 	int tr = square / 8;
 	int tf = square % 8;
@@ -707,6 +1541,102 @@ uint64_t RookAttacksOTF(int square, uint64_t blockers)
 	return attacks;
 }
 
+// every attack table is computed by the compiler, nothing is built at startup
+class AttackTables {
+public:
+	uint64_t pawn[2][64] = {};
+	uint64_t knight[64] = {};
+	uint64_t king[64] = {};
+	uint64_t rookMasks[64] = {};
+	uint64_t bishopMasks[64] = {};
+	uint64_t rook[64][4096] = {};
+	uint64_t bishop[64][512] = {};
+
+	constexpr AttackTables()
+	{
+		for (int sqr = 0; sqr < 64; sqr++)
+		{
+			pawn[WHITE][sqr] = MaskPawnAttacks(WHITE, sqr);
+			pawn[BLACK][sqr] = MaskPawnAttacks(BLACK, sqr);
+			knight[sqr] = MaskKnightAttacks(sqr);
+			king[sqr] = MaskKingAttacks(sqr);
+			bishopMasks[sqr] = MaskBishopAttacks(sqr);
+			rookMasks[sqr] = MaskRookAttacks(sqr);
+
+			// walk every subset of the mask (carry-rippler)
+			uint64_t occupancy = 0ULL;
+
+			do
+			{
+				bishop[sqr][(occupancy * bishopMagicNumbers[sqr]) >> (64 - bishopRelevantBits[sqr])] = BishopAttacksOTF(sqr, occupancy);
+				occupancy = (occupancy - bishopMasks[sqr]) & bishopMasks[sqr];
+			} while (occupancy);
+
+			do
+			{
+				rook[sqr][(occupancy * rookMagicNumbers[sqr]) >> (64 - rookRelevantBits[sqr])] = RookAttacksOTF(sqr, occupancy);
+				occupancy = (occupancy - rookMasks[sqr]) & rookMasks[sqr];
+			} while (occupancy);
+		}
+	}
+};
+
+constexpr AttackTables attackTables;
+
+constexpr const uint64_t (&pawnAttacks)[2][64] = attackTables.pawn;
+constexpr const uint64_t (&knightAttacks)[64] = attackTables.knight;
+constexpr const uint64_t (&kingAttacks)[64] = attackTables.king;
+constexpr const uint64_t (&rookMasks)[64] = attackTables.rookMasks;
+constexpr const uint64_t (&bishopMasks)[64] = attackTables.bishopMasks;
+constexpr const uint64_t (&rookAttacks)[64][4096] = attackTables.rook;
+constexpr const uint64_t (&bishopAttacks)[64][512] = attackTables.bishop;
+
+// Zobrist keys come from a fixed splitmix64 stream, so hashes are the same
+// on every build and platform
+#define ZOBRIST_SEED 0x9E3779B97F4A7C15ULL
+
+constexpr uint64_t SplitMix64(uint64_t &state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+class ZobristKeys {
+public:
+	uint64_t pieces[12][64] = {};
+	uint64_t castle[16] = {};
+	uint64_t ep[64] = {};
+	uint64_t side = 0;
+
+	constexpr ZobristKeys()
+	{
+		uint64_t state = ZOBRIST_SEED;
+
+		for (int piece = P; piece <= k; piece++)
+			for (int sq = 0; sq < 64; sq++)
+				pieces[piece][sq] = SplitMix64(state);
+
+		for (int i = 0; i < 16; i++)
+			castle[i] = SplitMix64(state);
+
+		for (int sq = 0; sq < 64; sq++)
+			ep[sq] = SplitMix64(state);
+
+		side = SplitMix64(state);
+	}
+};
+
+constexpr ZobristKeys zobristKeys;
+
+constexpr const uint64_t (&zobrist)[12][64] = zobristKeys.pieces;
+constexpr const uint64_t (&castleKeys)[16] = zobristKeys.castle;
+constexpr const uint64_t (&epKeys)[64] = zobristKeys.ep;
+constexpr uint64_t sideKey = zobristKeys.side;
+
 static inline uint64_t GetRookAttacks(int sqr, uint64_t occupancy)
 {
 	occupancy &= rookMasks[sqr];
@@ -732,7 +1662,7 @@ static inline uint64_t GetQueenAttacks(int sqr, uint64_t occupancy)
 
 static inline void AddMove(MoveList* moves, int move)
 {
-	moves->moves[moves->count] = move;
+	moves->moves[moves->count].move = move;
 	moves->count++;
 }
 
@@ -749,43 +1679,181 @@ static inline bool IsSqAttacked(int square, int side)
 	return false;
 }
 
-static inline void CopyBoard()
+static inline uint64_t PawnAttacksOf(int side)
 {
-	undo->ep[pos->ply] = pos->ep;
-	undo->ca[pos->ply] = pos->ca;
-	undo->side[pos->ply] = pos->side;
+	uint64_t pawns = pos->bb[side == WHITE ? P : p];
 
-	memcpy(undo->bb[pos->ply], pos->bb, sizeof(pos->bb));
-	memcpy(undo->occ[pos->ply], pos->occ, sizeof(pos->occ));
+	return side == WHITE
+		? ((pawns >> 7) & NOT_A_FILE) | ((pawns >> 9) & NOT_H_FILE)
+		: ((pawns << 7) & NOT_H_FILE) | ((pawns << 9) & NOT_A_FILE);
 }
 
-static inline void TakeBack()
+// fills the attack maps of one side, each slider lookup of the node happens here once
+static inline void ComputeAttacks(int side)
 {
-	pos->ep = undo->ep[pos->ply];
-	pos->ca = undo->ca[pos->ply];
+	AttackCache *cache = &pos->attacks;
+	int first = side == WHITE ? P : p;
 
-	if (pos->side < 0 || pos->side > 2) pos->side ^= 1;
+	// a king stepping back along a slider's line stays attacked
+	uint64_t occupancy = pos->occ[BOTH] & ~pos->bb[side == WHITE ? k : K];
+
+	cache->byPiece[first] = PawnAttacksOf(side);
+
+	for (int piece = first + 1; piece <= first + 5; piece++)
+	{
+		uint64_t bitboard = pos->bb[piece];
+		uint64_t attacks = 0ULL;
+
+		while (bitboard)
+		{
+			int square = GetLSB(bitboard);
+
+			switch (piece - first)
+			{
+				case N: attacks |= knightAttacks[square]; break;
+				case B: attacks |= GetBishopAttacks(square, occupancy); break;
+				case R: attacks |= GetRookAttacks(square, occupancy); break;
+				case Q: attacks |= GetQueenAttacks(square, occupancy); break;
+				case K: attacks |= kingAttacks[square]; break;
+			}
+
+			popBit(bitboard, square);
+		}
+
+		cache->byPiece[piece] = attacks;
+	}
+
+	cache->bySide[side] = 0ULL;
 
-	pos->side = undo->side[pos->ply];
+	for (int piece = first; piece <= first + 5; piece++)
+		cache->bySide[side] |= cache->byPiece[piece];
 
-	memcpy(pos->bb, undo->bb[pos->ply], sizeof(pos->bb));
-	memcpy(pos->occ, undo->occ[pos->ply], sizeof(pos->occ));
+	cache->valid |= side == WHITE ? ATTACKS_WHITE : ATTACKS_BLACK;
 }
 
-static inline void MovePiece(int from, int to, int piece)
+static inline uint64_t AttackedBy(int side)
 {
-	popBit(pos->bb[piece], from);
-	setBit(pos->bb[piece], to);
-	
-	pos->hashKey ^= zobrist[piece][from];
-	pos->hashKey ^= zobrist[piece][to];
+	if (!(pos->attacks.valid & (side == WHITE ? ATTACKS_WHITE : ATTACKS_BLACK)))
+		ComputeAttacks(side);
+
+	return pos->attacks.bySide[side];
 }
 
-static inline int MakeMove(int move)
+// checkers and pinned pieces of the side to move, from two lookups per slider kind plus one per pinner
+static inline void ComputePins()
 {
-	CopyBoard();
+	AttackCache *cache = &pos->attacks;
+	int us = pos->side;
+	int king = GetLSB(pos->bb[us == WHITE ? K : k]);
+	int enemy = us == WHITE ? p : P;
 
-	int fromSquare = getSource(move);
+	uint64_t own = pos->occ[us];
+	uint64_t occupancy = pos->occ[BOTH];
+	uint64_t rooks = pos->bb[enemy + R] | pos->bb[enemy + Q];
+	uint64_t bishops = pos->bb[enemy + B] | pos->bb[enemy + Q];
+	uint64_t rookRays = GetRookAttacks(king, occupancy);
+	uint64_t bishopRays = GetBishopAttacks(king, occupancy);
+
+	cache->checkers = (rookRays & rooks) | (bishopRays & bishops)
+		| (knightAttacks[king] & pos->bb[enemy + N]) | (pawnAttacks[us][king] & pos->bb[enemy]);
+
+	cache->pinned = 0ULL;
+
+	// sliders that see the king once our pieces in between are lifted
+	uint64_t pinners = GetRookAttacks(king, occupancy ^ (rookRays & own)) & rooks & ~rookRays;
+
+	while (pinners)
+	{
+		int square = GetLSB(pinners);
+		cache->pinned |= GetRookAttacks(square, occupancy) & rookRays & own;
+		popBit(pinners, square);
+	}
+
+	pinners = GetBishopAttacks(king, occupancy ^ (bishopRays & own)) & bishops & ~bishopRays;
+
+	while (pinners)
+	{
+		int square = GetLSB(pinners);
+		cache->pinned |= GetBishopAttacks(square, occupancy) & bishopRays & own;
+		popBit(pinners, square);
+	}
+
+	cache->valid |= ATTACKS_PINS;
+}
+
+static inline uint64_t Checkers()
+{
+	if (!(pos->attacks.valid & ATTACKS_PINS))
+		ComputePins();
+
+	return pos->attacks.checkers;
+}
+
+static inline uint64_t Pinned()
+{
+	if (!(pos->attacks.valid & ATTACKS_PINS))
+		ComputePins();
+
+	return pos->attacks.pinned;
+}
+
+// multiply-shift maps the key onto the table without a division
+static inline HashBucket *HashBucketFor(uint64_t key)
+{
+	return &hashTable->buckets[(uint64_t)(((unsigned __int128)key * hashTable->count) >> 64)];
+}
+
+static inline void CopyBoard()
+{
+	undo->ep[ss->ply] = pos->ep;
+	undo->ca[ss->ply] = pos->ca;
+	undo->side[ss->ply] = pos->side;
+	undo->fifty[ss->ply] = pos->fifty;
+	undo->fullmove[ss->ply] = pos->fullmove;
+	undo->hashKey[ss->ply] = pos->hashKey;
+
+	memcpy(undo->bb[ss->ply], pos->bb, sizeof(pos->bb));
+	memcpy(undo->occ[ss->ply], pos->occ, sizeof(pos->occ));
+	memcpy(undo->mailbox[ss->ply], pos->mailbox, sizeof(pos->mailbox));
+
+	undo->attacks[ss->ply] = pos->attacks;
+}
+
+static inline void TakeBack()
+{
+	pos->ep = undo->ep[ss->ply];
+	pos->ca = undo->ca[ss->ply];
+
+	if (pos->side < 0 || pos->side > 2) pos->side ^= 1;
+
+	pos->side = undo->side[ss->ply];
+	pos->fifty = undo->fifty[ss->ply];
+	pos->fullmove = undo->fullmove[ss->ply];
+	pos->hashKey = undo->hashKey[ss->ply];
+	pos->histPly--;
+
+	memcpy(pos->bb, undo->bb[ss->ply], sizeof(pos->bb));
+	memcpy(pos->occ, undo->occ[ss->ply], sizeof(pos->occ));
+	memcpy(pos->mailbox, undo->mailbox[ss->ply], sizeof(pos->mailbox));
+
+	pos->attacks = undo->attacks[ss->ply];
+}
+
+static inline void MovePiece(int from, int to, int piece)
+{
+	popBit(pos->bb[piece], from);
+	setBit(pos->bb[piece], to);
+
+	pos->mailbox[from] = NO_PIECE;
+	pos->mailbox[to] = piece;
+	
+	pos->hashKey ^= zobrist[piece][from];
+	pos->hashKey ^= zobrist[piece][to];
+}
+
+static inline int MakeMove(int move)
+{
+	int fromSquare = getSource(move);
     int toSquare = getTarget(move);
     int piece = getPiece(move);
     int promotedPiece = getPromoted(move);
@@ -794,46 +1862,66 @@ static inline int MakeMove(int move)
     int enpass = getEnpassant(move);
     int castle = getCastling(move);
 
-	MovePiece(fromSquare, toSquare, piece);
-	
-	if (capture)
-	{
-		int startPiece, endPiece;
+	STAT(stats->moves++);
 
-		if (pos->side == WHITE)
-		{
-			startPiece = p;
-			endPiece = k;
-		}
-		else
-		{
-			startPiece = P;
-			endPiece = K;
-		}
-			
-		for (int bbPiece = startPiece; bbPiece <= endPiece; bbPiece++)
+	// the parent's attack cache settles most moves, the rest are tested on the new board;
+	// it is filled before CopyBoard so later moves from this node find it again
+	bool verify = true;
+
+	if (piece == K || piece == k)
+	{
+		if (AttackedBy(pos->side ^ 1) & (1ULL << toSquare))
 		{
-			if (getBit(pos->bb[bbPiece], toSquare))
-			{
-				popBit(pos->bb[bbPiece], toSquare);
-				pos->hashKey ^= zobrist[bbPiece][toSquare];
-				break;
-			}
+			STAT(stats->illegalMoves++);
+			return 0;
 		}
+
+		verify = false;
+	}
+	else if (!enpass && !Checkers() && !(Pinned() & (1ULL << fromSquare)))
+		verify = false;
+
+	CopyBoard();
+
+	pos->attacks.valid = 0;
+	pos->hashHistory[pos->histPly++] = pos->hashKey;
+
+	pos->fifty++;
+
+	if (piece == P || piece == p || capture)
+		pos->fifty = 0;
+
+	if (pos->side == BLACK)
+		pos->fullmove++;
+
+	// the mailbox names the captured piece, enpassant captures are handled below
+	if (capture && !enpass)
+	{
+		int captured = pos->mailbox[toSquare];
+
+		popBit(pos->bb[captured], toSquare);
+		pos->hashKey ^= zobrist[captured][toSquare];
 	}
 
+	MovePiece(fromSquare, toSquare, piece);
+
 	if (promotedPiece)
 	{
-		(pos->side == WHITE) ? popBit(pos->bb[P], toSquare) : popBit(pos->bb[p], toSquare);
-		(pos->side == WHITE) ? pos->hashKey ^= zobrist[P][toSquare] : pos->hashKey ^= zobrist[p][toSquare];
+		popBit(pos->bb[piece], toSquare);
+		pos->hashKey ^= zobrist[piece][toSquare];
 		setBit(pos->bb[promotedPiece], toSquare);
 		pos->hashKey ^= zobrist[promotedPiece][toSquare];
+		pos->mailbox[toSquare] = promotedPiece;
 	}
 
 	if (enpass)
 	{
-		pos->side == WHITE ? popBit(pos->bb[p], toSquare + 8) : popBit(pos->bb[P], toSquare - 8);
-		pos->side == WHITE ? pos->hashKey ^= zobrist[p][toSquare + 8] : pos->hashKey ^= zobrist[P][toSquare - 8];
+		int square = pos->side == WHITE ? toSquare + 8 : toSquare - 8;
+		int captured = pos->side == WHITE ? p : P;
+
+		popBit(pos->bb[captured], square);
+		pos->hashKey ^= zobrist[captured][square];
+		pos->mailbox[square] = NO_PIECE;
 	}
 	
 	if (pos->ep != noSq)
@@ -870,26 +1958,33 @@ static inline int MakeMove(int move)
         }
     }
 
+	pos->hashKey ^= castleKeys[pos->ca];
+
 	pos->ca &= castlingRights[fromSquare];
 	pos->ca &= castlingRights[toSquare];
 	
 	pos->hashKey ^= castleKeys[pos->ca];
 
-    memset(pos->occ, 0, 24);
+	memset(pos->occ, 0, 24);
 
-    for (int bb_piece = P; bb_piece <= K; bb_piece++)
-        pos->occ[WHITE] |= pos->bb[bb_piece];
+	for (int bb_piece = P; bb_piece <= K; bb_piece++)
+		pos->occ[WHITE] |= pos->bb[bb_piece];
 
-    for (int bb_piece = p; bb_piece <= k; bb_piece++)
-        pos->occ[BLACK] |= pos->bb[bb_piece];
+	for (int bb_piece = p; bb_piece <= k; bb_piece++)
+		pos->occ[BLACK] |= pos->bb[bb_piece];
 
 	pos->occ[BOTH] = pos->occ[WHITE] | pos->occ[BLACK];
 
-    pos->side ^= 1;
-    pos->hashKey ^= sideKey;
+	pos->side ^= 1;
+	pos->hashKey ^= sideKey;
 
-	if (IsSqAttacked(pos->side == WHITE ? GetLSB(pos->bb[k]) : GetLSB(pos->bb[K]), pos->side))
+	// the child's key is final, start loading its bucket while legality is checked
+	__builtin_prefetch(HashBucketFor(pos->hashKey));
+
+	if (verify && IsSqAttacked(pos->side == WHITE ? GetLSB(pos->bb[k]) : GetLSB(pos->bb[K]), pos->side))
 	{
+		STAT(stats->illegalMoves++);
+
 		TakeBack();
 		return 0;
 	}
@@ -897,187 +1992,151 @@ static inline int MakeMove(int move)
 		return 1;
 }
 
-static inline void GenerateMoves(MoveList* moves)
+// every target of a set comes from the square at the same offset
+static inline void AddPawnMoves(MoveList *moves, uint64_t targets, int offset, int flag)
 {
-	int fromSquare, toSquare;
+	while (targets)
+	{
+		int toSquare = GetLSB(targets);
+		AddMove(moves, Move(toSquare + offset, toSquare, flag));
+		popBit(targets, toSquare);
+	}
+}
 
-	uint64_t bitboard = 0ULL;
-	uint64_t attacks = 0ULL;
+static inline void AddPromotions(MoveList *moves, uint64_t targets, int offset, int capture)
+{
+	while (targets)
+	{
+		int toSquare = GetLSB(targets);
 
-	moves->count = 0;
+		AddMove(moves, Move(toSquare + offset, toSquare, PROMO_Q | capture));
+		AddMove(moves, Move(toSquare + offset, toSquare, PROMO_R | capture));
+		AddMove(moves, Move(toSquare + offset, toSquare, PROMO_B | capture));
+		AddMove(moves, Move(toSquare + offset, toSquare, PROMO_N | capture));
 
-	for (int piece = P; piece <= k; piece++)
+		popBit(targets, toSquare);
+	}
+}
+
+// pushes and captures of all pawns at once by shifting the pawn bitboard
+static inline void GeneratePawnMoves(MoveList *moves)
+{
+	uint64_t empty = ~pos->occ[BOTH];
+	uint64_t pawns, push, doublePush, westCaptures, eastCaptures, lastRank;
+
+	// square difference of a single push
+	int up;
+
+	if (pos->side == WHITE)
 	{
-		bitboard = pos->bb[piece];
+		pawns = pos->bb[P];
+		push = (pawns >> 8) & empty;
+		doublePush = ((push & RANK_3) >> 8) & empty;
+		westCaptures = (pawns >> 9) & NOT_H_FILE & pos->occ[BLACK];
+		eastCaptures = (pawns >> 7) & NOT_A_FILE & pos->occ[BLACK];
+		lastRank = RANK_8;
+		up = -8;
+	}
+	else
+	{
+		pawns = pos->bb[p];
+		push = (pawns << 8) & empty;
+		doublePush = ((push & RANK_6) << 8) & empty;
+		westCaptures = (pawns << 7) & NOT_H_FILE & pos->occ[WHITE];
+		eastCaptures = (pawns << 9) & NOT_A_FILE & pos->occ[WHITE];
+		lastRank = RANK_1;
+		up = 8;
+	}
 
-		if (pos->side == WHITE)
-		{
-			if (piece == P)
-			{
-				while (bitboard)
-				{
-					fromSquare = GetLSB(bitboard);
-					toSquare = fromSquare - 8;
+	// most positions have no pawn about to promote
+	if ((push | westCaptures | eastCaptures) & lastRank)
+	{
+		AddPromotions(moves, push & lastRank, -up, 0);
+		AddPromotions(moves, westCaptures & lastRank, 1 - up, CAPTURE);
+		AddPromotions(moves, eastCaptures & lastRank, -1 - up, CAPTURE);
 
-					// generate quiet pawn moves
-					if (!getBit(pos->occ[BOTH], toSquare))
-					{
-						// promotion
-						if (fromSquare >= a7 && fromSquare <= h7)
-						{
-							AddMove(moves, Move(fromSquare, toSquare, piece, Q, 0, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, R, 0, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, B, 0, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, N, 0, 0, 0, 0));
-						}
-						else
-						{
-							// single pawn push
-							AddMove(moves, Move(fromSquare, toSquare, piece, 0, 0, 0, 0, 0));
+		push &= ~lastRank;
+		westCaptures &= ~lastRank;
+		eastCaptures &= ~lastRank;
+	}
 
-							// double pawn push
-							if ((fromSquare >= a2 && fromSquare <= h2) && !getBit(pos->occ[BOTH], toSquare - 8))
-								AddMove(moves, Move(fromSquare, toSquare - 8, piece, 0, 0, 1, 0, 0));
-						}
-					}
+	AddPawnMoves(moves, push, -up, QUIET);
+	AddPawnMoves(moves, doublePush, -2 * up, DOUBLE_PUSH);
+	AddPawnMoves(moves, westCaptures, 1 - up, CAPTURE);
+	AddPawnMoves(moves, eastCaptures, -1 - up, CAPTURE);
 
-					attacks = pawnAttacks[pos->side][fromSquare] & pos->occ[BLACK];
+	if (pos->ep != noSq)
+	{
+		// pawns that could capture onto the enpassant square are the ones it attacks as an enemy pawn
+		uint64_t attackers = pawnAttacks[pos->side ^ 1][pos->ep] & pawns;
 
-					// generate pawn captures
-					while (attacks)
-					{
-						toSquare = GetLSB(attacks);
+		while (attackers)
+		{
+			int fromSquare = GetLSB(attackers);
+			AddMove(moves, Move(fromSquare, pos->ep, EP_CAPTURE));
+			popBit(attackers, fromSquare);
+		}
+	}
+}
 
-						if (fromSquare >= a7 && fromSquare <= h7)
-						{
-							AddMove(moves, Move(fromSquare, toSquare, piece, Q, 1, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, R, 1, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, B, 1, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, N, 1, 0, 0, 0));
-						}
-						else
-							AddMove(moves, Move(fromSquare, toSquare, piece, 0, 1, 0, 0, 0));
+static inline void GenerateMoves(MoveList* moves)
+{
+	int fromSquare, toSquare;
 
-						popBit(attacks, toSquare);
-					}
+	uint64_t bitboard = 0ULL;
+	uint64_t attacks = 0ULL;
 
-					// generate enpassant captures
-					if (pos->ep != noSq)
-					{
-						uint64_t enpassant_attacks = pawnAttacks[pos->side][fromSquare] & (1ULL << pos->ep);
+	moves->count = 0;
 
-						if (enpassant_attacks)
-						{
-							int target_enpassant = (enpassant_attacks);
-							AddMove(moves, Move(fromSquare, target_enpassant, piece, 0, 1, 0, 1, 0));
-						}
-					}
+	GeneratePawnMoves(moves);
 
-					popBit(bitboard, fromSquare);
-				}
-			}
-			else if (piece == K)
+	for (int piece = P; piece <= k; piece++)
+	{
+		bitboard = pos->bb[piece];
+
+		if (pos->side == WHITE)
+		{
+			if (piece == K)
 			{
 				if (pos->ca & WK)
 				{
 					if (!getBit(pos->occ[BOTH], f1) && !getBit(pos->occ[BOTH], g1))
 					{
-						if (!IsSqAttacked(e1, BLACK) && !IsSqAttacked(f1, BLACK))
-							AddMove(moves, Move(e1, g1, piece, 0, 0, 0, 0, 1));
+						if (!(AttackedBy(BLACK) & ((1ULL << e1) | (1ULL << f1))))
+							AddMove(moves, Move(e1, g1, KING_CASTLE));
 					}
 				}
-				else if (pos->ca & WQ)
+
+				if (pos->ca & WQ)
 				{
 					if (!getBit(pos->occ[BOTH], d1) && !getBit(pos->occ[BOTH], c1) && !getBit(pos->occ[BOTH], b1))
 					{
-						if (!IsSqAttacked(e1, BLACK) && !IsSqAttacked(d1, BLACK))
-							AddMove(moves, Move(e1, c1, piece, 0, 0, 0, 0, 1));
+						if (!(AttackedBy(BLACK) & ((1ULL << e1) | (1ULL << d1))))
+							AddMove(moves, Move(e1, c1, QUEEN_CASTLE));
 					}
 				}
 			}
 		}
 		else
 		{
-			if (piece == p)
-			{
-				while (bitboard)
-				{
-					fromSquare = GetLSB(bitboard);
-					toSquare = fromSquare + 8;
-
-					// generate quiet pawn moves
-					if (!getBit(pos->occ[BOTH], toSquare))
-					{
-						if (fromSquare >= a2 && fromSquare <= h2)
-						{
-							AddMove(moves, Move(fromSquare, toSquare, piece, q, 0, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, r, 0, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, b, 0, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, n, 0, 0, 0, 0));
-						}
-						else
-						{
-							// generate single pawn pushes
-							AddMove(moves, Move(fromSquare, toSquare, piece, 0, 0, 0, 0, 0));
-
-							// generate double pawn pushes
-							if ((fromSquare >= a7 && fromSquare <= h7) && !getBit(pos->occ[BOTH], toSquare + 8))
-								AddMove(moves, Move(fromSquare, toSquare + 8, piece, 0, 0, 1, 0, 0));
-						}
-					}
-
-					attacks = pawnAttacks[pos->side][fromSquare] & pos->occ[WHITE];
-
-					// generate pawn captures
-					while (attacks)
-					{
-						toSquare = GetLSB(attacks);
-
-						if (fromSquare >= a2 && fromSquare <= h2)
-						{
-							AddMove(moves, Move(fromSquare, toSquare, piece, q, 1, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, r, 1, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, b, 1, 0, 0, 0));
-							AddMove(moves, Move(fromSquare, toSquare, piece, n, 1, 0, 0, 0));
-						}
-						else
-							AddMove(moves, Move(fromSquare, toSquare, piece, 0, 1, 0, 0, 0));
-
-						popBit(attacks, toSquare);
-					}
-
-					// generate enpassant captures
-					if (pos->ep != noSq)
-					{
-						uint64_t enpassant_attacks = pawnAttacks[pos->side][fromSquare] & (1ULL << pos->ep);
-
-						if (enpassant_attacks)
-						{
-							int target_enpassant = GetLSB(enpassant_attacks);
-							AddMove(moves, Move(fromSquare, target_enpassant, piece, 0, 1, 0, 1, 0));
-						}
-					}
-
-					popBit(bitboard, fromSquare);
-				}
-			}
-			else if (piece == k)
+			if (piece == k)
 			{
 				if (pos->ca & BK)
 				{
 					if (!getBit(pos->occ[BOTH], f8) && !getBit(pos->occ[BOTH], g8))
 					{
-						if (!IsSqAttacked(e8, WHITE) && !IsSqAttacked(f8, WHITE))
-							AddMove(moves, Move(e8, g8, piece, 0, 0, 0, 0, 1));
+						if (!(AttackedBy(WHITE) & ((1ULL << e8) | (1ULL << f8))))
+							AddMove(moves, Move(e8, g8, KING_CASTLE));
 					}
 				}
-				else if (pos->ca & BQ)
+
+				if (pos->ca & BQ)
 				{
 					if (!getBit(pos->occ[BOTH], d8) && !getBit(pos->occ[BOTH], c8) && !getBit(pos->occ[BOTH], b8))
 					{
-						if (!IsSqAttacked(e8, WHITE) && !IsSqAttacked(d8, WHITE))
+						if (!(AttackedBy(WHITE) & ((1ULL << e8) | (1ULL << d8))))
 						{
-							AddMove(moves, Move(e8, c8, piece, 0, 0, 0, 0, 1));
+							AddMove(moves, Move(e8, c8, QUEEN_CASTLE));
 						}
 					}
 				}
@@ -1099,10 +2158,10 @@ static inline void GenerateMoves(MoveList* moves)
 
 					// quiet moves
 					if (!getBit(((pos->side == WHITE) ? pos->occ[BLACK] : pos->occ[WHITE]), toSquare))
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 0, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, QUIET));
 					// capture moves
 					else
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 1, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, CAPTURE));
 
 					popBit(attacks, toSquare);
 				}
@@ -1126,10 +2185,10 @@ static inline void GenerateMoves(MoveList* moves)
 
 					// quiet moves
 					if (!getBit(((pos->side == WHITE) ? pos->occ[BLACK] : pos->occ[WHITE]), toSquare))
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 0, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, QUIET));
 					// capture moves
 					else
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 1, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, CAPTURE));
 
 					popBit(attacks, toSquare);
 				}
@@ -1153,10 +2212,10 @@ static inline void GenerateMoves(MoveList* moves)
 
 					// quiet moves
 					if (!getBit(((pos->side == WHITE) ? pos->occ[BLACK] : pos->occ[WHITE]), toSquare))
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 0, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, QUIET));
 					// capture moves
 					else
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 1, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, CAPTURE));
 
 					popBit(attacks, toSquare);
 				}
@@ -1180,10 +2239,10 @@ static inline void GenerateMoves(MoveList* moves)
 
 					// quiet moves
 					if (!getBit(((pos->side == WHITE) ? pos->occ[BLACK] : pos->occ[WHITE]), toSquare))
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 0, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, QUIET));
 					// capture moves
 					else
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 1, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, CAPTURE));
 
 					popBit(attacks, toSquare);
 				}
@@ -1207,10 +2266,10 @@ static inline void GenerateMoves(MoveList* moves)
 
 					// quiet moves
 					if (!getBit(((pos->side == WHITE) ? pos->occ[BLACK] : pos->occ[WHITE]), toSquare))
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 0, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, QUIET));
 					// capture moves
 					else
-						AddMove(moves, Move(fromSquare, toSquare, piece, 0, 1, 0, 0, 0));
+						AddMove(moves, Move(fromSquare, toSquare, CAPTURE));
 
 					popBit(attacks, toSquare);
 				}
@@ -1221,340 +2280,4566 @@ static inline void GenerateMoves(MoveList* moves)
 	}
 }
 
-static inline int Evaluate()
+// material, piece-square, mobility, king zone attack and pawn threat terms of one side in a
+// single pass over its pieces; the piece attacks also fill the node's attack cache when it
+// has no map for the side yet
+static inline int EvaluateSide(int side)
 {
-    int score = 0;
-    int square = 0;
+	AttackCache *cache = &pos->attacks;
+	int flag = side == WHITE ? ATTACKS_WHITE : ATTACKS_BLACK;
+	bool fill = !(cache->valid & flag);
 
-    uint64_t bb = 0ULL;
+	int first = side == WHITE ? P : p;
+	int enemy = side == WHITE ? p : P;
+	int enemyKing = GetLSB(pos->bb[enemy + K]);
 
-    for (int piece = P; piece <= k; piece++)
-    {
-        bb = pos->bb[piece];
-
-        while (bb)
-        {
-            square = GetLSB(bb);
-
-            score += materialScore[piece];
-
-            switch (piece)
-            {
-                case P: score += pawnScore[square]; break;
-                case N: score += knightScore[square]; break;
-                case B: 
-                    score += bishopScore[square]; 
-                    //score += CountBits(GetBishopAttacks(square, pos->occ[BOTH]));
-                    break;
-                case R: 
-                    score += rookScore[square]; 
-                    //score += countBits(GetRookAttacks(square, pos->occ[BOTH]));
-                    break;
-                case Q: 
-                    score += queenScore[square]; 
-                    //score += countBits(GetQueenAttacks(square, pos->occ[BOTH]));
-                    break;
-                case K: score += kingScore[square]; break;
-
-                case p: score -= pawnScore[mirrorScore[square]]; break;
-                case n: score -= knightScore[mirrorScore[square]]; break;
-                case b: 
-                    score -= bishopScore[mirrorScore[square]]; 
-                    //score -= countBits(getBishopAttacks(square, pos->occ[both]));
-                    break;
-                case r: 
-                    score -= rookScore[mirrorScore[square]]; 
-                    //score -= countBits(getRookAttacks(square, pos->occ[both]));
-                    break;
-                case q: 
-                    score -= queenScore[mirrorScore[square]]; 
-                    //score -= countBits(getQueenAttacks(square, pos->occ[both]));
-                    break;
-                case k: score -= kingScore[mirrorScore[square]]; break;
-            }
-
-            popBit(bb, square);
-        }
-    }
-
-    return pos->side == WHITE ? score : -score;
-}
-
-static inline int NegaMax(int depth, int alpha, int beta)
-{
-	if (depth == 0)
-		return Evaluate();
+	uint64_t occupancy = pos->occ[BOTH] & ~pos->bb[enemy + K];
+	uint64_t enemyPawnAttacks = PawnAttacksOf(side ^ 1);
+	uint64_t area = ~pos->occ[side] & ~enemyPawnAttacks;
+	uint64_t zone = kingAttacks[enemyKing] | (1ULL << enemyKing);
 
 	int score = 0;
-	int legalMoves = 0;
-
-	bool inCheck = IsSqAttacked(pos->side == WHITE ? pos->bb[k] : pos->bb[K], pos->side ^ 1);
-
-	MoveList moves[1];
-	GenerateMoves(moves);
+	int attackers = 0;
+	int attackUnits = 0;
 
-	for (int i = 0; i < moves->count; i++)
+	for (int kind = P; kind <= K; kind++)
 	{
-		CopyBoard();
-
-		if (!MakeMove(moves->moves[i]))
-			continue;
+		uint64_t bitboard = pos->bb[first + kind];
+		uint64_t all = 0ULL;
 
-		legalMoves++;
-		pos->ply++;
-		score = -NegaMax(depth - 1, -beta, -alpha);
-		pos->ply--;
+		while (bitboard)
+		{
+			int square = GetLSB(bitboard);
+			uint64_t attacks;
 
-		TakeBack();
+			popBit(bitboard, square);
 
-		if (score >= beta)
-			return beta;
+			score += materialScore[kind] + pieceSquareScore[kind][side == WHITE ? square : mirrorScore[square]];
 
-		if (score > alpha)
-		{
-			alpha = score;
+			switch (kind)
+			{
+				case N: attacks = knightAttacks[square]; break;
+				case B: attacks = GetBishopAttacks(square, occupancy); break;
+				case R: attacks = GetRookAttacks(square, occupancy); break;
+				case Q: attacks = GetQueenAttacks(square, occupancy); break;
+				default: continue;
+			}
 
-			pos->pvTable[pos->ply][pos->ply] = moves->moves[i];
+			score += mobilityWeight[kind] * (CountBits(attacks & area) - mobilityBase[kind]);
 
-            for (int nextPly = pos->ply + 1; nextPly < pos->pvLength[pos->ply + 1]; nextPly++)
-				pos->pvTable[pos->ply][nextPly] = pos->pvTable[pos->ply + 1][nextPly];
+			if (attacks & zone)
+			{
+				attackers++;
+				attackUnits += kingAttackWeight[kind];
+			}
 
-			pos->pvLength[pos->ply] = pos->pvLength[pos->ply + 1];
+			all |= attacks;
 		}
+
+		if (fill)
+			cache->byPiece[first + kind] = all;
 	}
 
-	if (!legalMoves)
+	score += attackUnits * kingAttackShare[min(attackers, 7)] / 100;
+	score -= pawnThreat * CountBits(pos->occ[side] & ~pos->bb[first] & ~pos->bb[first + K] & enemyPawnAttacks);
+
+	if (fill)
 	{
-		if (inCheck)
-			return -49000 + pos->ply;
-		else
-			return 0;
+		cache->byPiece[first] = PawnAttacksOf(side);
+		cache->byPiece[first + K] = kingAttacks[GetLSB(pos->bb[first + K])];
+		cache->bySide[side] = 0ULL;
+
+		for (int piece = first; piece <= first + K; piece++)
+			cache->bySide[side] |= cache->byPiece[piece];
+
+		cache->valid |= flag;
 	}
 
-	return alpha;
+	return score;
 }
 
-static inline void Perft(int depth)
+static inline int Evaluate()
 {
-	if (depth == 0)
+	int score = EvaluateSide(WHITE) - EvaluateSide(BLACK);
+
+	return pos->side == WHITE ? score : -score;
+}
+
+// Evaluate through the eval cache, the key covers the side to move so the stored score
+// is already side-relative
+static inline int CachedEvaluate()
+{
+	uint64_t *entry = &evalCache->entries[pos->hashKey & evalCache->mask];
+	uint64_t data = __atomic_load_n(entry, __ATOMIC_RELAXED);
+
+	STAT(stats->evalProbes++);
+
+	// the index is taken from the low bits, the tag check from the high 48
+	if (!((data ^ pos->hashKey) >> 16))
 	{
-		sInfo->nodes++;
-		return;
+		STAT(stats->evalHits++);
+		return (int16_t)data;
 	}
 
-	MoveList moves[1];
-	GenerateMoves(moves);
+	int score = Evaluate();
 
-	for (int i = 0; i < moves->count; i++)
-	{
-		CopyBoard();
+	__atomic_store_n(entry, (pos->hashKey & ~0xFFFFULL) | (uint16_t)score, __ATOMIC_RELAXED);
 
-		if (!MakeMove(moves->moves[i]))
-			continue;
+	return score;
+}
 
-		pos->ply++;
-		Perft(depth - 1);
-		pos->ply--;
+// anonymous memory for hash tables on 2 MB pages: explicit huge pages when some are reserved,
+// otherwise a 2 MB aligned mapping the kernel can back with transparent huge pages
+void *AllocLargePages(size_t &size)
+{
+	size = (size + LARGE_PAGE_SIZE - 1) & ~(size_t)(LARGE_PAGE_SIZE - 1);
 
-		TakeBack();
-	}
+#ifdef MAP_HUGETLB
+	void *huge = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+	if (huge != MAP_FAILED)
+		return huge;
+#endif
+
+	char *base = (char *)mmap(NULL, size + LARGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (base == MAP_FAILED)
+		return NULL;
+
+	// trim the slack so both ends of the table fall on 2 MB boundaries
+	char *aligned = (char *)(((uintptr_t)base + LARGE_PAGE_SIZE - 1) & ~(uintptr_t)(LARGE_PAGE_SIZE - 1));
+
+	if (aligned > base)
+		munmap(base, aligned - base);
+
+	munmap(aligned + size, base + LARGE_PAGE_SIZE - aligned);
+
+#ifdef MADV_HUGEPAGE
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+	return aligned;
 }
 
-uint64_t rand64()
+void FreeHash()
 {
-	return rand() ^ ((uint64_t)rand() << 15) ^ ((uint64_t)rand() << 30) ^ ((uint64_t)rand() << 45) ^ ((uint64_t)rand() << 60);
+	if (hashTable->header)
+		munmap(hashTable->header, hashTable->size);
+
+	hashTable->header = NULL;
+	hashTable->buckets = NULL;
+	hashTable->count = 0;
+	hashTable->size = 0;
 }
 
-void initZobristKeys()
+void ClearHash()
 {
-	for (int piece = P; piece <= k; piece++)
-		for (int sq = 0; sq < 64; sq++)
-			zobrist[piece][sq] = rand64();
-			
-	for (int i = 0; i < 16; i++)
-		castleKeys[i] = rand64();
-		
-	for (int sq = 0; sq < 64; sq++)
-		epKeys[sq] = rand64();
-		
-	sideKey = rand64();
+	memset(hashTable->buckets, 0, hashTable->count * sizeof(HashBucket));
 }
 
-uint64_t generateHashKey(Position *pos)
+// writes dirty pages of a file-backed table to disk
+void SaveHash()
 {
-	uint64_t finalKey = 0ULL;
-	uint64_t bb = 0ULL;
-		
-	int sq = 0;
-		
-	for (int piece = P; piece <= k; piece++)
+	if (hashTable->header && !hashTable->path.empty())
+		msync(hashTable->header, hashTable->size, MS_SYNC);
+}
+
+static bool HashHeaderValid(HashFileHeader *header, size_t fileSize)
+{
+	return !memcmp(header->magic, "CPPCHASH", 8)
+		&& header->version == HASH_FORMAT_VERSION
+		&& header->bucketSize == sizeof(HashBucket)
+		&& header->seed == ZOBRIST_SEED
+		&& header->count
+		&& fileSize == sizeof(HashFileHeader) + header->count * sizeof(HashBucket);
+}
+
+// a valid existing file is adopted with its own size, pages are read in as the search touches them
+bool InitHash(int mb, const char *path)
+{
+	struct stat st;
+	HashFileHeader header;
+
+	FreeHash();
+
+	hashTable->mb = mb;
+	hashTable->path = path;
+
+	uint64_t count = ((uint64_t)mb << 20) / sizeof(HashBucket);
+
+	// the 64 byte header keeps the buckets on cache line boundaries
+	if (hashTable->path.empty())
 	{
-		bb = pos->bb[piece];
-			
-		while (bb)
+		hashTable->size = sizeof(HashFileHeader) + count * sizeof(HashBucket);
+
+		void *base = AllocLargePages(hashTable->size);
+
+		if (!base)
+			return false;
+
+		hashTable->header = (HashFileHeader *)base;
+		hashTable->buckets = (HashBucket *)(hashTable->header + 1);
+		hashTable->count = count;
+
+		return true;
+	}
+
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	bool loaded = st.st_size >= (off_t)sizeof(header)
+		&& pread(fd, &header, sizeof(header), 0) == sizeof(header) && HashHeaderValid(&header, st.st_size);
+
+	// only an empty file or an outdated hash file is (re)written, a mistyped path must not wipe anything else
+	if (!loaded && st.st_size && (st.st_size < (off_t)sizeof(header) || memcmp(header.magic, "CPPCHASH", 8)))
+	{
+		cout << "info string " << path << " is not a hash file, left untouched" << endl;
+		close(fd);
+		return false;
+	}
+
+	if (loaded)
+		count = header.count;
+	else
+	{
+		// truncating to zero first leaves a sparse, all-empty table
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "CPPCHASH", 8);
+		header.version = HASH_FORMAT_VERSION;
+		header.bucketSize = sizeof(HashBucket);
+		header.seed = ZOBRIST_SEED;
+		header.count = count;
+
+		if (ftruncate(fd, 0) < 0 || ftruncate(fd, sizeof(header) + count * sizeof(HashBucket)) < 0
+			|| pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
 		{
-			sq = GetLSB(bb);
-			finalKey ^= zobrist[piece][sq];
-			popBit(bb, sq);
+			close(fd);
+			return false;
 		}
 	}
-		
-	if (pos->ep != noSq)
-		finalKey ^= epKeys[pos->ep];
-			
-	finalKey ^= castleKeys[pos->ca];
-		
-	if(pos->side == BLACK)
-		finalKey ^= sideKey;
-		
-	return finalKey;
+
+	hashTable->size = sizeof(HashFileHeader) + count * sizeof(HashBucket);
+
+	void *base = mmap(NULL, hashTable->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (base == MAP_FAILED)
+		return false;
+
+	hashTable->header = (HashFileHeader *)base;
+	hashTable->buckets = (HashBucket *)(hashTable->header + 1);
+	hashTable->count = count;
+
+	cout << "info string hash file " << path << (loaded ? " loaded, " : " created, ") << count * HASH_BUCKET_SIZE << " entries" << endl;
+
+	return true;
 }
 
-void ParseFen(Position *pos, char* fen)
+// a trial mapping before a pool of workers starts, so a size that cannot be had fails once up front
+bool CanAllocateHash(int mb)
 {
-	pos->reset();
+	size_t size = sizeof(HashFileHeader) + ((uint64_t)mb << 20) / sizeof(HashBucket) * sizeof(HashBucket);
+	void *base = AllocLargePages(size);
 
-	for (int rank = 0; rank < 8; rank++)
+	if (!base)
+		return false;
+
+	munmap(base, size);
+
+	return true;
+}
+
+void FreeEvalCache()
+{
+	if (evalCache->entries)
+		munmap(evalCache->entries, evalCache->size);
+
+	evalCache->entries = NULL;
+	evalCache->mask = 0;
+	evalCache->size = 0;
+}
+
+// a power of two entries within mb, the cache is lossy so rounding down costs little;
+// the old cache stays in place until the new one is mapped
+bool InitEvalCache(int mb)
+{
+	uint64_t count = 1;
+
+	while (count * 2 * sizeof(uint64_t) <= ((uint64_t)mb << 20))
+		count *= 2;
+
+	size_t size = count * sizeof(uint64_t);
+	uint64_t *entries = (uint64_t *)AllocLargePages(size);
+
+	if (!entries)
+		return false;
+
+	FreeEvalCache();
+
+	evalCache->entries = entries;
+	evalCache->mask = count - 1;
+	evalCache->size = size;
+	evalCache->mb = mb;
+
+	return true;
+}
+
+static inline int ReadHashEntry(int alpha, int beta, int depth, int *move)
+{
+	HashEntry *entry = HashBucketFor(pos->hashKey)->entries;
+	HashEntry *last = entry + HASH_BUCKET_SIZE;
+
+	STAT(stats->hashProbes++);
+
+	while (entry < last && entry->key != pos->hashKey)
+		entry++;
+
+	if (entry == last)
+		return NO_HASH_ENTRY;
+
+	STAT(stats->hashHits++);
+
+	*move = entry->move;
+
+	if (entry->depth < depth)
+		return NO_HASH_ENTRY;
+
+	// mate and tablebase scores are stored relative to the node, not the root
+	int score = entry->score;
+
+	if (score < -TB_WIN_SCORE + MAX_PLY)
+		score += ss->ply;
+
+	if (score > TB_WIN_SCORE - MAX_PLY)
+		score -= ss->ply;
+
+	if (entry->flag == HASH_EXACT)
+		return score;
+
+	if (entry->flag == HASH_ALPHA && score <= alpha)
+		return alpha;
+
+	if (entry->flag == HASH_BETA && score >= beta)
+		return beta;
+
+	return NO_HASH_ENTRY;
+}
+
+static inline void WriteHashEntry(int score, int depth, int flag, int move)
+{
+	HashEntry *bucket = HashBucketFor(pos->hashKey)->entries;
+	HashEntry *entry = bucket;
+
+	int age = hashTable->header->age;
+
+	// the same position is overwritten in place, otherwise the shallowest entry goes, and
+	// every search generation an entry is old costs it as much as 4 plies of depth
+	for (int i = 0; i < HASH_BUCKET_SIZE; i++)
 	{
-		for (int file = 0; file < 8; file++)
+		if (bucket[i].key == pos->hashKey)
 		{
-			int square = rank * 8 + file;
+			entry = &bucket[i];
+			break;
+		}
 
-			if ((*fen >= 'a' && *fen <= 'z') || (*fen >= 'A' && *fen <= 'Z'))
-			{
-				int piece = charToPiece[*fen];
-				setBit(pos->bb[piece], square);
-				fen++;
-			}
+		if (bucket[i].depth - 4 * ((age - bucket[i].age) & HASH_AGE_MASK) < entry->depth - 4 * ((age - entry->age) & HASH_AGE_MASK))
+			entry = &bucket[i];
+	}
 
-			if (*fen >= '0' && *fen <= '9')
-			{
-				int offset = *fen - '0';
-				int target_piece = -1;
+	if (score < -TB_WIN_SCORE + MAX_PLY)
+		score -= ss->ply;
 
-				for (int piece = P; piece <= k; piece++)
-				{
-					if (getBit(pos->bb[piece], square))
-						target_piece = piece;
-				}
+	if (score > TB_WIN_SCORE - MAX_PLY)
+		score += ss->ply;
 
-				if (target_piece == -1)
-					file--;
+	entry->key = pos->hashKey;
+	entry->move = move;
+	entry->score = score;
+	entry->depth = depth;
+	entry->flag = flag;
+	entry->age = age;
+}
 
-				file += offset;
+static inline bool InCheck()
+{
+	return Checkers() != 0;
+}
 
-				fen++;
-			}
+static inline bool HasLegalMove()
+{
+	MoveList moves[1];
+	GenerateMoves(moves);
 
-			if (*fen == '/')
-				*fen++;
+	for (int i = 0; i < moves->count; i++)
+	{
+		if (MakeMove(moves->moves[i].move))
+		{
+			TakeBack();
+			return true;
 		}
 	}
 
-	// go to side to move
-	fen++;
+	return false;
+}
 
-	(*fen == 'w') ? (pos->side = WHITE) : (pos->side = BLACK);
+// only positions since the last irreversible move can repeat, and only with the same side to move
+static inline bool IsRepetition()
+{
+	int reps = 0;
+	int stop = pos->histPly - pos->fifty;
 
-	// go to castling rights
-	fen += 2;
+	if (stop < 0)
+		stop = 0;
 
-	while (*fen != ' ')
+	for (int i = pos->histPly - 4; i >= stop; i -= 2)
 	{
-		switch (*fen)
+		if (pos->hashHistory[i] == pos->hashKey)
 		{
-		case 'K': pos->ca |= WK; break;
-		case 'Q': pos->ca |= WQ; break;
-		case 'k': pos->ca |= BK; break;
-		case 'q': pos->ca |= BQ; break;
-		case '-': break;
+			// a repeat inside the search tree is a draw at two-fold, game history needs three-fold
+			if (i > pos->histPly - ss->ply || ++reps == 2)
+				return true;
 		}
+	}
 
-		fen++;
+	return false;
+}
+
+// Syzygy tablebases. Probing works in the format's own convention: squares
+// count from a1 and pieces are coded 1-6 for white and 9-14 for black.
+
+static inline int TBOffA1H8(int sq)
+{
+	return (sq >> 3) - (sq & 7);
+}
+
+static inline bool TBPawnsCompare(int a, int b)
+{
+	return tbMapPawns[a] < tbMapPawns[b];
+}
+
+// piece counts packed four bits per piece, exact for any reachable material
+static inline uint64_t TBMaterialKey(Position *pos)
+{
+	uint64_t key = 0ULL;
+
+	for (int piece = P; piece <= k; piece++)
+		key |= (uint64_t)CountBits(pos->bb[piece]) << (4 * piece);
+
+	return key;
+}
+
+void TBInitTables()
+{
+	int code = 0;
+
+	// MapB1H1H7 numbers the squares below the a1-h8 diagonal
+	for (int sq = 0; sq < 64; sq++)
+		if (TBOffA1H8(sq) < 0)
+			tbMapB1H1H7[sq] = code++;
+
+	// MapA1D1D4 numbers the a1-d1-d4 triangle, diagonal squares last
+	int diagonal[4];
+	int diagonalCount = 0;
+
+	code = 0;
+
+	for (int sq = 0; sq <= 27; sq++)
+	{
+		if (TBOffA1H8(sq) < 0 && (sq & 7) <= 3)
+			tbMapA1D1D4[sq] = code++;
+		else if (!TBOffA1H8(sq) && (sq & 7) <= 3)
+			diagonal[diagonalCount++] = sq;
 	}
 
-	// go to enpassant square
-	fen++;
+	for (int i = 0; i < diagonalCount; i++)
+		tbMapA1D1D4[diagonal[i]] = code++;
+
+	// MapKK numbers the 462 legal king pairs with the first king in the triangle,
+	// pairs with both kings on the diagonal come last
+	int bothOnDiagonal[64][2];
+	int bothCount = 0;
+
+	code = 0;
 
-	if (*fen != '-')
+	for (int idx = 0; idx < 10; idx++)
 	{
-		int file = fen[0] - 'a';
-		int rank = 8 - (fen[1] - '0');
+		for (int s1 = 0; s1 <= 27; s1++)
+		{
+			if (tbMapA1D1D4[s1] != idx || (!idx && s1 != 1))
+				continue;
 
-		pos->ep = rank * 8 + file;
+			for (int s2 = 0; s2 < 64; s2++)
+			{
+				if (s1 == s2 || getBit(kingAttacks[s1 ^ 56], (s2 ^ 56)))
+					continue;
+				else if (!TBOffA1H8(s1) && TBOffA1H8(s2) > 0)
+					continue;
+				else if (!TBOffA1H8(s1) && !TBOffA1H8(s2))
+				{
+					bothOnDiagonal[bothCount][0] = idx;
+					bothOnDiagonal[bothCount++][1] = s2;
+				}
+				else
+					tbMapKK[idx][s2] = code++;
+			}
+		}
 	}
-	else
-		pos->ep = noSq;
 
-	for (int piece = P; piece <= K; piece++)
-		pos->occ[WHITE] |= pos->bb[piece];
+	for (int i = 0; i < bothCount; i++)
+		tbMapKK[bothOnDiagonal[i][0]][bothOnDiagonal[i][1]] = code++;
 
-	for (int piece = p; piece <= k; piece++)
-		pos->occ[BLACK] |= pos->bb[piece];
+	tbBinomial[0][0] = 1;
+
+	for (int n = 1; n < 64; n++)
+		for (int i = 0; i < 6 && i <= n; i++)
+			tbBinomial[i][n] = (i > 0 ? tbBinomial[i - 1][n - 1] : 0) + (i < n ? tbBinomial[i][n - 1] : 0);
+
+	// MapPawns numbers a2-h7 so that the leading pawn, nearest the edge and
+	// lowest on its file, gets the highest value
+	int availableSquares = 47;
+
+	for (int leadPawnsCnt = 1; leadPawnsCnt <= 5; leadPawnsCnt++)
+	{
+		for (int file = 0; file <= 3; file++)
+		{
+			int idx = 0;
+
+			for (int rank = 1; rank <= 6; rank++)
+			{
+				int sq = rank * 8 + file;
+
+				if (leadPawnsCnt == 1)
+				{
+					tbMapPawns[sq] = availableSquares--;
+					tbMapPawns[sq ^ 7] = availableSquares--;
+				}
+
+				tbLeadPawnIdx[leadPawnsCnt][sq] = idx;
+				idx += tbBinomial[leadPawnsCnt - 1][tbMapPawns[sq]];
+			}
+
+			tbLeadPawnsSize[leadPawnsCnt][file] = idx;
+		}
+	}
+}
+
+static int TBSetSymlen(PairsData *d, int sym, vector<bool> &visited)
+{
+	visited[sym] = true;
+
+	const unsigned char *lr = d->btree + 3 * sym;
+	int right = (lr[2] << 4) | (lr[1] >> 4);
+
+	if (right == 0xFFF)
+		return 0;
+
+	int left = ((lr[1] & 0xF) << 8) | lr[0];
+
+	if (!visited[left])
+		d->symlen[left] = TBSetSymlen(d, left, visited);
+
+	if (!visited[right])
+		d->symlen[right] = TBSetSymlen(d, right, visited);
+
+	return d->symlen[left] + d->symlen[right] + 1;
+}
+
+static const unsigned char *TBSetSizes(PairsData *d, const unsigned char *data)
+{
+	d->flags = *data++;
+
+	// every position of the table has the same value
+	if (d->flags & TB_SINGLE_VALUE)
+	{
+		d->numBlocks = 0;
+		d->span = 0;
+		d->sparseIndexSize = 0;
+		d->blockLengthSize = 0;
+		d->minSymLen = *data++;
+
+		return data;
+	}
+
+	// groupLen is zero terminated, the matching groupIdx holds the table size
+	int groups = 0;
+
+	while (d->groupLen[groups])
+		groups++;
+
+	uint64_t tbSize = d->groupIdx[groups];
+
+	d->sizeofBlock = 1ULL << *data++;
+	d->span = 1ULL << *data++;
+	d->sparseIndexSize = (tbSize + d->span - 1) / d->span;
+
+	int padding = *data++;
+
+	d->numBlocks = ReadLittleEndian(data, 4);
+	data += 4;
+
+	d->blockLengthSize = d->numBlocks + padding;
+	d->maxSymLen = *data++;
+	d->minSymLen = *data++;
+	d->lowestSym = data;
+	d->base64.assign(d->maxSymLen - d->minSymLen + 1, 0ULL);
+
+	// canonical Huffman code: longer symbols have lower values, base64[len]
+	// is the lowest 64 bit left-aligned code of each length
+	for (int i = (int)d->base64.size() - 2; i >= 0; i--)
+		d->base64[i] = (d->base64[i + 1] + ReadLittleEndian(d->lowestSym + 2 * i, 2) - ReadLittleEndian(d->lowestSym + 2 * (i + 1), 2)) / 2;
+
+	for (int i = 0; i < (int)d->base64.size(); i++)
+		d->base64[i] <<= 64 - i - d->minSymLen;
 
-    pos->occ[BOTH] = pos->occ[BLACK] | pos->occ[WHITE];
+	data += d->base64.size() * 2;
 
-	pos->hashKey = generateHashKey(pos);
+	d->symlen.assign(ReadLittleEndian(data, 2), 0);
+	data += 2;
+
+	d->btree = data;
+
+	// symbols are built by recursive pairing, each one expands to symlen + 1 values
+	vector<bool> visited(d->symlen.size());
+
+	for (int sym = 0; sym < (int)d->symlen.size(); sym++)
+		if (!visited[sym])
+			d->symlen[sym] = TBSetSymlen(d, sym, visited);
+
+	return data + d->symlen.size() * 3 + (d->symlen.size() & 1);
 }
 
-void initAttackMasks()
+static void TBSetGroups(TBTable *e, PairsData *d, int order[2], int file)
 {
-	for (int square = 0; square < 64; square++)
+	int n = 0;
+	int firstLen = e->hasPawns ? 0 : e->hasUniquePieces ? 3 : 2;
+
+	d->groupLen[n] = 1;
+
+	for (int i = 1; i < e->pieceCount; i++)
+	{
+		if (--firstLen > 0 || d->pieces[i] == d->pieces[i - 1])
+			d->groupLen[n]++;
+		else
+			d->groupLen[++n] = 1;
+	}
+
+	d->groupLen[++n] = 0;
+
+	// groups are encoded in the order stored in the file, the leading group
+	// at order[0] and the remaining pawns, if any, at order[1]
+	bool pp = e->hasPawns && e->pawnCount[1];
+	int next = pp ? 2 : 1;
+	int freeSquares = 64 - d->groupLen[0] - (pp ? d->groupLen[1] : 0);
+	uint64_t idx = 1;
+
+	for (int i = 0; next < n || i == order[0] || i == order[1]; i++)
 	{
-		pawnAttacks[WHITE][square] = MaskPawnAttacks(WHITE, square);
-		pawnAttacks[BLACK][square] = MaskPawnAttacks(BLACK, square);
-		knightAttacks[square] = MaskKnightAttacks(square);
-		kingAttacks[square] = MaskKingAttacks(square);
-		bishopMasks[square] = MaskBishopAttacks(square);
-		rookMasks[square] = MaskRookAttacks(square);
+		if (i == order[0])
+		{
+			d->groupIdx[0] = idx;
+			idx *= e->hasPawns ? tbLeadPawnsSize[d->groupLen[0]][file] : e->hasUniquePieces ? 31332 : 462;
+		}
+		else if (i == order[1])
+		{
+			d->groupIdx[1] = idx;
+			idx *= tbBinomial[d->groupLen[1]][48 - d->groupLen[0]];
+		}
+		else
+		{
+			d->groupIdx[next] = idx;
+			idx *= tbBinomial[d->groupLen[next]][freeSquares];
+			freeSquares -= d->groupLen[next++];
+		}
 	}
+
+	d->groupIdx[n] = idx;
 }
 
-void initSliderAttacks(bool isBishop)
+static const unsigned char *TBSetDtzMap(TBTable *e, const unsigned char *data, int maxFile)
 {
-	for (int sqr = 0; sqr < 64; sqr++)
+	e->map = data;
+
+	for (int file = 0; file <= maxFile; file++)
 	{
-		uint64_t attackMask = isBishop ? bishopMasks[sqr] : rookMasks[sqr];
-		int relevantBitsCount = CountBits(attackMask);
-		int occupancyIndices = (1 << relevantBitsCount);
+		PairsData *d = &e->items[0][file];
+
+		if (!(d->flags & TB_MAPPED))
+			continue;
 
-		for (int index = 0; index < occupancyIndices; index++)
+		if (d->flags & TB_WIDE)
 		{
-			if (isBishop)
+			data += (uintptr_t)data & 1;
+
+			for (int i = 0; i < 4; i++)
 			{
-				uint64_t occupancy = SetOccupancy(index, relevantBitsCount, attackMask);
-				int magic_index = (occupancy * bishopMagicNumbers[sqr]) >> (64 - bishopRelevantBits[sqr]);
-				bishopAttacks[sqr][magic_index] = BishopAttacksOTF(sqr, occupancy);
+				d->mapIdx[i] = (data - e->map) / 2 + 1;
+				data += 2 * ReadLittleEndian(data, 2) + 2;
 			}
-			else
+		}
+		else
+		{
+			for (int i = 0; i < 4; i++)
 			{
-				uint64_t occupancy = SetOccupancy(index, relevantBitsCount, attackMask);
-				int magic_index = (occupancy * rookMagicNumbers[sqr]) >> (64 - rookRelevantBits[sqr]);
-				rookAttacks[sqr][magic_index] = RookAttacksOTF(sqr, occupancy);
+				d->mapIdx[i] = data - e->map + 1;
+				data += *data + 1;
 			}
 		}
 	}
+
+	return data + ((uintptr_t)data & 1);
 }
 
-void InitAll()
+static void TBSet(TBTable *e, const unsigned char *data)
 {
-	initAttackMasks();
-	initSliderAttacks(true);
-	initSliderAttacks(false);
-	initZobristKeys();
+	// first byte holds the split and pawn flags, both known from the material
+	data++;
+
+	int sides = (!e->isDTZ && e->key != e->key2) ? 2 : 1;
+	int maxFile = e->hasPawns ? 3 : 0;
+	bool pp = e->hasPawns && e->pawnCount[1];
+
+	for (int file = 0; file <= maxFile; file++)
+	{
+		for (int i = 0; i < sides; i++)
+			e->items[i][file] = PairsData();
+
+		int order[2][2] = {
+			{ data[0] & 0xF, pp ? data[1] & 0xF : 0xF },
+			{ data[0] >> 4, pp ? data[1] >> 4 : 0xF }
+		};
+
+		data += 1 + pp;
+
+		for (int i = 0; i < e->pieceCount; i++, data++)
+			for (int side = 0; side < sides; side++)
+				e->items[side][file].pieces[i] = side ? *data >> 4 : *data & 0xF;
+
+		for (int i = 0; i < sides; i++)
+			TBSetGroups(e, &e->items[i][file], order[i], file);
+	}
+
+	data += (uintptr_t)data & 1;
+
+	for (int file = 0; file <= maxFile; file++)
+		for (int i = 0; i < sides; i++)
+			data = TBSetSizes(&e->items[i][file], data);
+
+	if (e->isDTZ)
+		data = TBSetDtzMap(e, data, maxFile);
+
+	for (int file = 0; file <= maxFile; file++)
+	{
+		for (int i = 0; i < sides; i++)
+		{
+			e->items[i][file].sparseIndex = data;
+			data += e->items[i][file].sparseIndexSize * 6;
+		}
+	}
+
+	for (int file = 0; file <= maxFile; file++)
+	{
+		for (int i = 0; i < sides; i++)
+		{
+			e->items[i][file].blockLength = data;
+			data += e->items[i][file].blockLengthSize * 2;
+		}
+	}
+
+	for (int file = 0; file <= maxFile; file++)
+	{
+		for (int i = 0; i < sides; i++)
+		{
+			data = (const unsigned char *)(((uintptr_t)data + 0x3F) & ~(uintptr_t)0x3F);
+			e->items[i][file].data = data;
+			data += e->items[i][file].numBlocks * e->items[i][file].sizeofBlock;
+		}
+	}
 }
 
-int main()
+// tables are mapped on first probe, the mapping is shared by every thread
+static bool TBMap(TBTable *e)
 {
-	InitAll();
+	static const unsigned char magics[2][4] = { { 0x71, 0xE8, 0x23, 0x5D }, { 0xD7, 0x66, 0x0C, 0xA5 } };
+	struct stat st;
 
-	ParseFen(pos, startPosition);
-	PrintBoard(pos);
+	if (e->ready.load(memory_order_acquire))
+		return true;
 
-	int score = -NegaMax(5, -50000, 50000);
+	lock_guard<mutex> lock(syzygy->mapLock);
 
-	cout << "Score: " << score << endl;
-	cout << "Best Move: " << notation[getSource(pos->pvTable[0][0])] << notation[getTarget(pos->pvTable[0][0])] << endl;
-	
-	return 0;	
+	if (e->ready.load(memory_order_relaxed))
+		return true;
+
+	if (e->failed)
+		return false;
+
+	e->failed = 1;
+
+	int fd = open(e->path.c_str(), O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0 || st.st_size % 64 != 16)
+	{
+		cout << "info string corrupt tablebase file " << e->path << endl;
+		close(fd);
+		return false;
+	}
+
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (base == MAP_FAILED)
+		return false;
+
+	madvise(base, st.st_size, MADV_RANDOM);
+
+	if (memcmp(base, magics[e->isDTZ], 4))
+	{
+		cout << "info string corrupt tablebase file " << e->path << endl;
+		munmap(base, st.st_size);
+		return false;
+	}
+
+	e->base = base;
+	e->size = st.st_size;
+
+	TBSet(e, (const unsigned char *)base + 4);
+
+	e->failed = 0;
+	e->ready.store(true, memory_order_release);
+
+	return true;
+}
+
+static int TBDecompressPairs(PairsData *d, uint64_t idx)
+{
+	if (d->flags & TB_SINGLE_VALUE)
+		return d->minSymLen;
+
+	// the sparse index points into blockLength near idx, walk from there to
+	// the block holding idx; block n stores blockLength[n] + 1 values
+	uint32_t k = idx / d->span;
+
+	uint32_t block = ReadLittleEndian(d->sparseIndex + 6 * k, 4);
+	int offset = ReadLittleEndian(d->sparseIndex + 6 * k + 4, 2);
+
+	offset += (int64_t)(idx % d->span) - (int64_t)(d->span / 2);
+
+	while (offset < 0)
+		offset += ReadLittleEndian(d->blockLength + 2 * --block, 2) + 1;
+
+	while (offset > (int)ReadLittleEndian(d->blockLength + 2 * block, 2))
+		offset -= ReadLittleEndian(d->blockLength + 2 * block++, 2) + 1;
+
+	const unsigned char *ptr = d->data + (uint64_t)block * d->sizeofBlock;
+
+	uint64_t buf64 = ReadBigEndian(ptr, 8);
+	int buf64Size = 64;
+	int sym;
+
+	ptr += 8;
+
+	while (true)
+	{
+		int len = 0;
+
+		while (buf64 < d->base64[len])
+			len++;
+
+		sym = (buf64 - d->base64[len]) >> (64 - len - d->minSymLen);
+		sym += ReadLittleEndian(d->lowestSym + 2 * len, 2);
+
+		if (offset < d->symlen[sym] + 1)
+			break;
+
+		offset -= d->symlen[sym] + 1;
+		len += d->minSymLen;
+		buf64 <<= len;
+		buf64Size -= len;
+
+		if (buf64Size <= 32)
+		{
+			buf64Size += 32;
+			buf64 |= ReadBigEndian(ptr, 4) << (64 - buf64Size);
+			ptr += 4;
+		}
+	}
+
+	// expand the pair tree down to the single value at offset
+	while (d->symlen[sym])
+	{
+		const unsigned char *lr = d->btree + 3 * sym;
+		int left = ((lr[1] & 0xF) << 8) | lr[0];
+
+		if (offset < d->symlen[left] + 1)
+			sym = left;
+		else
+		{
+			offset -= d->symlen[left] + 1;
+			sym = (lr[2] << 4) | (lr[1] >> 4);
+		}
+	}
+
+	const unsigned char *lr = d->btree + 3 * sym;
+
+	return ((lr[1] & 0xF) << 8) | lr[0];
+}
+
+static int TBMapScore(TBTable *e, int file, int value, int wdl)
+{
+	static const int wdlMap[] = { 1, 3, 0, 2, 0 };
+
+	if (!e->isDTZ)
+		return value - 2;
+
+	PairsData *d = &e->items[0][e->hasPawns ? file : 0];
+
+	if (d->flags & TB_MAPPED)
+	{
+		if (d->flags & TB_WIDE)
+			value = ReadLittleEndian(e->map + 2 * (d->mapIdx[wdlMap[wdl + 2]] + value), 2);
+		else
+			value = e->map[d->mapIdx[wdlMap[wdl + 2]] + value];
+	}
+
+	// tables store moves or plies depending on the flags, we want plies
+	if ((wdl == WDL_WIN && !(d->flags & TB_WIN_PLIES)) || (wdl == WDL_LOSS && !(d->flags & TB_LOSS_PLIES))
+		|| wdl == WDL_CURSED_WIN || wdl == WDL_BLESSED_LOSS)
+		value *= 2;
+
+	return value + 1;
+}
+
+static int TBDoProbe(TBTable *e, int wdl, int *result)
+{
+	int board[64];
+	int squares[TB_PIECES];
+	int pieces[TB_PIECES];
+	int size = 0;
+	int leadPawnsCnt = 0;
+	int leadPawn = 0;
+	int tbFile = 0;
+	uint64_t idx;
+
+	memset(board, 0, sizeof(board));
+
+	for (int piece = P; piece <= k; piece++)
+	{
+		uint64_t bb = pos->bb[piece];
+
+		while (bb)
+		{
+			int sq = GetLSB(bb);
+			board[sq ^ 56] = piece % 6 + 1 + (piece >= p ? 8 : 0);
+			popBit(bb, sq);
+		}
+	}
+
+	// tables only store white as the stronger side, and only white to move when
+	// the material is symmetric; otherwise swap colours and mirror the board
+	bool symmetricBlackToMove = e->key == e->key2 && pos->side == BLACK;
+	bool blackStronger = TBMaterialKey(pos) != e->key;
+
+	int flipColor = (symmetricBlackToMove || blackStronger) * 8;
+	int flipSquares = (symmetricBlackToMove || blackStronger) * 56;
+	int stm = (symmetricBlackToMove || blackStronger) ^ pos->side;
+
+	// pawn tables are split by the file of the leading pawn
+	if (e->hasPawns)
+	{
+		leadPawn = e->items[0][0].pieces[0] ^ flipColor;
+
+		for (int sq = 0; sq < 64; sq++)
+			if (board[sq] == leadPawn)
+				squares[size++] = sq ^ flipSquares;
+
+		leadPawnsCnt = size;
+
+		swap(squares[0], *max_element(squares, squares + leadPawnsCnt, TBPawnsCompare));
+
+		tbFile = squares[0] & 7;
+
+		if (tbFile > 3)
+			tbFile = (squares[0] ^ 7) & 7;
+	}
+
+	// DTZ tables are one-sided, the caller has to search one ply deeper
+	if (e->isDTZ)
+	{
+		int flags = e->items[0][tbFile].flags;
+
+		if ((flags & TB_STM) != stm && !(e->key == e->key2 && !e->hasPawns))
+		{
+			*result = PROBE_CHANGE_STM;
+			return 0;
+		}
+	}
+
+	for (int sq = 0; sq < 64; sq++)
+	{
+		if (board[sq] && !(e->hasPawns && board[sq] == leadPawn))
+		{
+			squares[size] = sq ^ flipSquares;
+			pieces[size++] = board[sq] ^ flipColor;
+		}
+	}
+
+	PairsData *d = &e->items[e->isDTZ ? 0 : stm][tbFile];
+
+	// order the pieces the way the table encodes them
+	for (int i = leadPawnsCnt; i < size - 1; i++)
+	{
+		for (int j = i + 1; j < size; j++)
+		{
+			if (d->pieces[i] == pieces[j])
+			{
+				swap(pieces[i], pieces[j]);
+				swap(squares[i], squares[j]);
+				break;
+			}
+		}
+	}
+
+	// bring the leading piece to files a-d
+	if ((squares[0] & 7) > 3)
+		for (int i = 0; i < size; i++)
+			squares[i] ^= 7;
+
+	if (e->hasPawns)
+	{
+		idx = tbLeadPawnIdx[leadPawnsCnt][squares[0]];
+
+		stable_sort(squares + 1, squares + leadPawnsCnt, TBPawnsCompare);
+
+		for (int i = 1; i < leadPawnsCnt; i++)
+			idx += tbBinomial[i][tbMapPawns[squares[i]]];
+	}
+	else
+	{
+		// without pawns also bring it below rank 5 and below the a1-h8 diagonal
+		if ((squares[0] >> 3) > 3)
+			for (int i = 0; i < size; i++)
+				squares[i] ^= 56;
+
+		for (int i = 0; i < d->groupLen[0]; i++)
+		{
+			if (!TBOffA1H8(squares[i]))
+				continue;
+
+			if (TBOffA1H8(squares[i]) > 0)
+				for (int j = i; j < size; j++)
+					squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+
+			break;
+		}
+
+		if (e->hasUniquePieces)
+		{
+			int adjust1 = squares[1] > squares[0];
+			int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+			if (TBOffA1H8(squares[0]))
+				idx = (tbMapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+			else if (TBOffA1H8(squares[1]))
+				idx = (6 * 63 + (squares[0] >> 3) * 28 + tbMapB1H1H7[squares[1]]) * 62 + squares[2] - adjust2;
+			else if (TBOffA1H8(squares[2]))
+				idx = 6 * 63 * 62 + 4 * 28 * 62 + (squares[0] >> 3) * 7 * 28
+					+ ((squares[1] >> 3) - adjust1) * 28 + tbMapB1H1H7[squares[2]];
+			else
+				idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + (squares[0] >> 3) * 7 * 6
+					+ ((squares[1] >> 3) - adjust1) * 6 + ((squares[2] >> 3) - adjust2);
+		}
+		else
+			idx = tbMapKK[tbMapA1D1D4[squares[0]]][squares[1]];
+	}
+
+	idx *= d->groupIdx[0];
+
+	// remaining groups in ascending square order, each square shifted down
+	// past the squares taken by the earlier groups
+	int groupStart = d->groupLen[0];
+	bool remainingPawns = e->hasPawns && e->pawnCount[1];
+
+	for (int next = 1; d->groupLen[next]; next++)
+	{
+		sort(squares + groupStart, squares + groupStart + d->groupLen[next]);
+
+		uint64_t n = 0;
+
+		for (int i = 0; i < d->groupLen[next]; i++)
+		{
+			int adjust = 0;
+
+			for (int j = 0; j < groupStart; j++)
+				adjust += squares[groupStart + i] > squares[j];
+
+			n += tbBinomial[i + 1][squares[groupStart + i] - adjust - 8 * remainingPawns];
+		}
+
+		remainingPawns = false;
+		idx += n * d->groupIdx[next];
+		groupStart += d->groupLen[next];
+	}
+
+	return TBMapScore(e, tbFile, TBDecompressPairs(d, idx), wdl);
+}
+
+static int TBProbeTable(bool dtz, int *result, int wdl)
+{
+	// KvK has no file
+	if (CountBits(pos->occ[BOTH]) == 2)
+		return 0;
+
+	map<uint64_t, TBTable *> &tables = dtz ? syzygy->dtz : syzygy->wdl;
+	map<uint64_t, TBTable *>::iterator entry = tables.find(TBMaterialKey(pos));
+
+	if (entry == tables.end() || !TBMap(entry->second))
+	{
+		*result = PROBE_FAIL;
+		return 0;
+	}
+
+	return TBDoProbe(entry->second, wdl, result);
+}
+
+// tables hold no enpassant positions and may store don't-care values where a
+// capture wins, so captures (and pawn moves for DTZ) are resolved by search
+static int TBSearch(int *result, bool checkZeroingMoves)
+{
+	int value;
+	int bestValue = WDL_LOSS;
+	int totalCount = 0;
+	int moveCount = 0;
+
+	MoveList moves[1];
+	GenerateMoves(moves);
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		int move = moves->moves[i].move;
+		bool zeroing = getCapture(move) || (checkZeroingMoves && (getPiece(move) == P || getPiece(move) == p));
+
+		if (!MakeMove(move))
+			continue;
+
+		totalCount++;
+
+		if (!zeroing)
+		{
+			TakeBack();
+			continue;
+		}
+
+		moveCount++;
+
+		ss->ply++;
+		value = -TBSearch(result, false);
+		ss->ply--;
+
+		TakeBack();
+
+		if (*result == PROBE_FAIL)
+			return WDL_DRAW;
+
+		if (value > bestValue)
+		{
+			bestValue = value;
+
+			if (value >= WDL_WIN)
+			{
+				*result = PROBE_ZEROING_BEST_MOVE;
+				return value;
+			}
+		}
+	}
+
+	bool noMoreMoves = moveCount && moveCount == totalCount;
+
+	if (noMoreMoves)
+		value = bestValue;
+	else
+	{
+		value = TBProbeTable(false, result, WDL_DRAW);
+
+		if (*result == PROBE_FAIL)
+			return WDL_DRAW;
+	}
+
+	if (bestValue >= value)
+	{
+		*result = (bestValue > WDL_DRAW || noMoreMoves) ? PROBE_ZEROING_BEST_MOVE : PROBE_OK;
+		return bestValue;
+	}
+
+	*result = PROBE_OK;
+
+	return value;
+}
+
+int TBProbeWDL(int *result)
+{
+	*result = PROBE_OK;
+
+	return TBSearch(result, false);
+}
+
+static inline int TBDtzBeforeZeroing(int wdl)
+{
+	return wdl == WDL_WIN ? 1 : wdl == WDL_CURSED_WIN ? 101 : wdl == WDL_BLESSED_LOSS ? -101 : wdl == WDL_LOSS ? -1 : 0;
+}
+
+static inline int Sign(int value)
+{
+	return (value > 0) - (value < 0);
+}
+
+// distance to zeroing in plies, positive when the side to move wins
+int TBProbeDTZ(int *result)
+{
+	*result = PROBE_OK;
+
+	int wdl = TBSearch(result, true);
+
+	if (*result == PROBE_FAIL || wdl == WDL_DRAW)
+		return 0;
+
+	if (*result == PROBE_ZEROING_BEST_MOVE)
+		return TBDtzBeforeZeroing(wdl);
+
+	int dtz = TBProbeTable(true, result, wdl);
+
+	if (*result == PROBE_FAIL)
+		return 0;
+
+	if (*result != PROBE_CHANGE_STM)
+		return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) * Sign(wdl);
+
+	// the table stores the other side, take the best reply one ply deeper
+	int minDTZ = 0xFFFF;
+
+	MoveList moves[1];
+	GenerateMoves(moves);
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		int move = moves->moves[i].move;
+		bool zeroing = getCapture(move) || getPiece(move) == P || getPiece(move) == p;
+
+		if (!MakeMove(move))
+			continue;
+
+		ss->ply++;
+
+		dtz = zeroing ? -TBDtzBeforeZeroing(TBSearch(result, false)) : -TBProbeDTZ(result);
+
+		if (dtz == 1 && InCheck() && !HasLegalMove())
+			minDTZ = 1;
+
+		if (!zeroing)
+			dtz += Sign(dtz);
+
+		if (dtz < minDTZ && Sign(dtz) == Sign(wdl))
+			minDTZ = dtz;
+
+		ss->ply--;
+		TakeBack();
+
+		if (*result == PROBE_FAIL)
+			return 0;
+	}
+
+	return minDTZ == 0xFFFF ? -1 : minDTZ;
+}
+
+static inline bool TBCanProbe()
+{
+	return syzygy->largest && !pos->ca && ss->ply < MAX_PLY - TB_PIECES && CountBits(pos->occ[BOTH]) <= min(syzygy->largest, syzygy->probeLimit);
+}
+
+// a position since the last capture or pawn move that occurred twice, the game is going round in circles
+static bool TBHasRepeated()
+{
+	int stop = max(0, pos->histPly - pos->fifty);
+
+	for (int i = pos->histPly; i >= stop + 4; i--)
+	{
+		uint64_t key = i == pos->histPly ? pos->hashKey : pos->hashHistory[i];
+
+		for (int j = i - 4; j >= stop; j -= 2)
+			if (pos->hashHistory[j] == key)
+				return true;
+	}
+
+	return false;
+}
+
+// ranks the root moves by DTZ and leaves the best ranked ones in searchMoves, returns how many;
+// wins that the fifty-move rule would spoil rank below clean wins, and once the game has repeated
+// every win ranks by its distance so the search cannot keep shuffling between winning moves
+int TBRootProbe(int *score)
+{
+	int result = PROBE_OK;
+	int bestRank = -INF;
+	int cnt50 = pos->fifty;
+	bool repeated = TBHasRepeated();
+	int ranks[256];
+
+	MoveList moves[1];
+	GenerateMoves(moves);
+
+	ss->searchMoveCount = 0;
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		int move = moves->moves[i].move;
+		int dtz;
+
+		if (!MakeMove(move))
+			continue;
+
+		ss->ply++;
+
+		if (pos->fifty == 0)
+			dtz = TBDtzBeforeZeroing(-TBProbeWDL(&result));
+		else if (pos->fifty >= 100 || IsRepetition())
+			dtz = 0;
+		else
+		{
+			dtz = -TBProbeDTZ(&result);
+			dtz += Sign(dtz);
+		}
+
+		if (dtz == 2 && InCheck() && !HasLegalMove())
+			dtz = 1;
+
+		ss->ply--;
+		TakeBack();
+
+		if (result == PROBE_FAIL)
+		{
+			ss->searchMoveCount = 0;
+			return 0;
+		}
+
+		int rank = dtz > 0 ? (dtz + cnt50 <= 99 && !repeated ? TB_MAX_DTZ : TB_MAX_DTZ - (dtz + cnt50))
+			: dtz < 0 ? (-dtz * 2 + cnt50 < 100 ? -TB_MAX_DTZ : -TB_MAX_DTZ + (-dtz + cnt50))
+			: 0;
+
+		ss->searchMoves[ss->searchMoveCount] = move;
+		ranks[ss->searchMoveCount++] = rank;
+		bestRank = max(bestRank, rank);
+	}
+
+	// moves of equal rank are left to the search to tell apart
+	int count = 0;
+
+	for (int i = 0; i < ss->searchMoveCount; i++)
+		if (ranks[i] == bestRank)
+			ss->searchMoves[count++] = ss->searchMoves[i];
+
+	ss->searchMoveCount = count;
+
+	*score = bestRank >= TB_MAX_DTZ - 100 ? TB_WIN_SCORE : bestRank <= -TB_MAX_DTZ + 100 ? -TB_WIN_SCORE : 0;
+
+	return count;
+}
+
+static bool TBFindFile(const string &name, string &path)
+{
+	struct stat st;
+
+	for (size_t i = 0; i < syzygy->paths.size(); i++)
+	{
+		path = syzygy->paths[i] + "/" + name;
+
+		if (!stat(path.c_str(), &st))
+			return true;
+	}
+
+	return false;
+}
+
+static void TBAddTable(const string &white, const string &black)
+{
+	static const char pieceChars[] = "PNBRQK";
+	string name = "K" + white + "vK" + black;
+	string path;
+
+	for (int dtz = 0; dtz <= 1; dtz++)
+	{
+		if (!TBFindFile(name + (dtz ? ".rtbz" : ".rtbw"), path))
+			continue;
+
+		syzygy->tables.emplace_back();
+
+		TBTable *e = &syzygy->tables.back();
+		int counts[12] = { 0 };
+
+		counts[K] = counts[k] = 1;
+
+		for (size_t i = 0; i < white.size(); i++)
+			counts[strchr(pieceChars, white[i]) - pieceChars]++;
+
+		for (size_t i = 0; i < black.size(); i++)
+			counts[strchr(pieceChars, black[i]) - pieceChars + 6]++;
+
+		e->name = name;
+		e->path = path;
+		e->isDTZ = dtz;
+		e->pieceCount = white.size() + black.size() + 2;
+		e->hasPawns = counts[P] || counts[p];
+
+		for (int piece = P; piece < K; piece++)
+			if (counts[piece] == 1 || counts[piece + 6] == 1)
+				e->hasUniquePieces = 1;
+
+		// the side with fewer pawns leads, it compresses better
+		bool whiteLeads = !counts[p] || (counts[P] && counts[p] >= counts[P]);
+
+		e->pawnCount[0] = whiteLeads ? counts[P] : counts[p];
+		e->pawnCount[1] = whiteLeads ? counts[p] : counts[P];
+
+		for (int piece = P; piece <= k; piece++)
+		{
+			e->key |= (uint64_t)counts[piece] << (4 * piece);
+			e->key2 |= (uint64_t)counts[(piece + 6) % 12] << (4 * piece);
+		}
+
+		map<uint64_t, TBTable *> &tables = dtz ? syzygy->dtz : syzygy->wdl;
+
+		tables[e->key] = e;
+		tables[e->key2] = e;
+
+		if (!dtz)
+			syzygy->largest = max(syzygy->largest, e->pieceCount);
+	}
+}
+
+// all piece sets of one side, strongest piece first as in the file names
+static void TBSideSets(vector<string> &sets, const string &side, int from, int left)
+{
+	sets.push_back(side);
+
+	if (!left)
+		return;
+
+	for (int i = from; i < 5; i++)
+		TBSideSets(sets, side + "QRBNP"[i], i, left - 1);
+}
+
+void TBFree()
+{
+	for (size_t i = 0; i < syzygy->tables.size(); i++)
+		if (syzygy->tables[i].base)
+			munmap(syzygy->tables[i].base, syzygy->tables[i].size);
+
+	syzygy->wdl.clear();
+	syzygy->dtz.clear();
+	syzygy->tables.clear();
+	syzygy->paths.clear();
+	syzygy->largest = 0;
+}
+
+// paths are separated by ':', an empty path disables probing
+void TBInit(const char *paths)
+{
+	static bool tablesReady = false;
+	vector<string> sets;
+
+	TBFree();
+
+	if (!tablesReady)
+	{
+		TBInitTables();
+		tablesReady = true;
+	}
+
+	for (const char *start = paths; *start; )
+	{
+		const char *end = strchr(start, ':');
+
+		if (!end)
+			end = start + strlen(start);
+
+		if (end > start)
+			syzygy->paths.push_back(string(start, end));
+
+		start = *end ? end + 1 : end;
+	}
+
+	if (syzygy->paths.empty())
+		return;
+
+	TBSideSets(sets, "", 0, TB_PIECES - 2);
+
+	for (size_t w = 0; w < sets.size(); w++)
+		for (size_t b = 0; b < sets.size(); b++)
+			if (sets[w].size() + sets[b].size() + 2 <= TB_PIECES)
+				TBAddTable(sets[w], sets[b]);
+
+	int count = 0;
+
+	for (size_t i = 0; i < syzygy->tables.size(); i++)
+		count += !syzygy->tables[i].isDTZ;
+
+	cout << "info string found " << count << " tablebases, up to " << syzygy->largest << " pieces" << endl;
+}
+
+// most valuable victim first, then least valuable attacker
+static inline int CaptureScore(int move)
+{
+	// enpassant targets an empty square and quiet promotions capture nothing
+	int victim = pos->mailbox[getTarget(move)] == NO_PIECE ? P : pos->mailbox[getTarget(move)];
+
+	return MVV_LVA[getPiece(move)][victim];
+}
+
+// continuation history following the move made back plies ago, NULL when that is before the root
+static inline int16_t (*Continuation(int back))[64]
+{
+	if (ss->ply < back)
+		return NULL;
+
+	int ply = ss->ply - back;
+
+	return ss->continuation[ss->pieces[ply]][getTarget(ss->moves[ply])];
+}
+
+static inline int QuietScore(int move, int16_t (*cont1)[64], int16_t (*cont2)[64])
+{
+	int piece = getPiece(move);
+	int target = getTarget(move);
+	int score = ss->history[piece][target];
+
+	if (cont1)
+		score += cont1[piece][target];
+
+	if (cont2)
+		score += cont2[piece][target];
+
+	return score;
+}
+
+// hash move, captures and promotions by MVV-LVA, killers, the counter move,
+// then quiet moves by butterfly and continuation history
+static inline void ScoreMoves(MoveList *moves, int hashMove)
+{
+	int16_t (*cont1)[64] = Continuation(1);
+	int16_t (*cont2)[64] = Continuation(2);
+	int counter = ss->ply ? ss->counterMoves[ss->pieces[ss->ply - 1]][getTarget(ss->moves[ss->ply - 1])] : 0;
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		int move = moves->moves[i].move;
+		int score;
+
+		if (move == hashMove)
+			score = HASH_MOVE_SCORE;
+		else if (getCapture(move) || getPromotion(move))
+			score = CAPTURE_SCORE + CaptureScore(move);
+		else if (move == ss->killers[ss->ply][0])
+			score = KILLER_SCORE + 1;
+		else if (move == ss->killers[ss->ply][1])
+			score = KILLER_SCORE;
+		else if (move == counter)
+			score = COUNTER_SCORE;
+		else
+			score = QuietScore(move, cont1, cont2);
+
+		moves->moves[i].score = score;
+	}
+}
+
+// selection sort step, brings the best remaining move to index
+static inline void PickMove(MoveList *moves, int index)
+{
+	int best = index;
+
+	for (int i = index + 1; i < moves->count; i++)
+		if (moves->moves[i].score > moves->moves[best].score)
+			best = i;
+
+	swap(moves->moves[index], moves->moves[best]);
+}
+
+// gravity update, an entry moves toward +-HISTORY_MAX and slows down as it gets there
+static inline int Gravity(int value, int bonus)
+{
+	return value + bonus - value * abs(bonus) / HISTORY_MAX;
+}
+
+static inline void UpdateQuietHistory(int move, int bonus, int16_t (*cont1)[64], int16_t (*cont2)[64])
+{
+	int piece = getPiece(move);
+	int target = getTarget(move);
+
+	ss->history[piece][target] = Gravity(ss->history[piece][target], bonus);
+
+	if (cont1)
+		cont1[piece][target] = Gravity(cont1[piece][target], bonus);
+
+	if (cont2)
+		cont2[piece][target] = Gravity(cont2[piece][target], bonus);
+}
+
+// called for the quiet move that failed high, the quiet moves searched before it lose the same amount
+static inline void UpdateQuietMove(int move, int depth, int *quiets, int quietCount)
+{
+	int bonus = min(32 * depth * depth, HISTORY_MAX / 8);
+	int16_t (*cont1)[64] = Continuation(1);
+	int16_t (*cont2)[64] = Continuation(2);
+
+	if (ss->killers[ss->ply][0] != move)
+	{
+		ss->killers[ss->ply][1] = ss->killers[ss->ply][0];
+		ss->killers[ss->ply][0] = move;
+	}
+
+	if (ss->ply)
+		ss->counterMoves[ss->pieces[ss->ply - 1]][getTarget(ss->moves[ss->ply - 1])] = move;
+
+	UpdateQuietHistory(move, bonus, cont1, cont2);
+
+	for (int i = 0; i < quietCount; i++)
+		UpdateQuietHistory(quiets[i], -bonus, cont1, cont2);
+}
+
+// captures only, until the position is quiet
+// the node budget is checked on every node instead of with the clock, the search stops on the exact count
+static inline bool NodeLimitReached()
+{
+	if (sInfo->nodeLimit && sInfo->nodes >= sInfo->nodeLimit)
+		sInfo->stopped = 1;
+
+	return sInfo->stopped;
+}
+
+static inline int Quiescence(int alpha, int beta)
+{
+	if (NodeLimitReached())
+		return 0;
+
+	if ((sInfo->nodes & 2047) == 0)
+		CheckUp();
+
+	sInfo->nodes++;
+
+	STAT(stats->nodesPerPly[ss->ply]++);
+	STAT(stats->qnodes++);
+
+	int eval;
+
+	STAT_TIME(evalTime, eval = CachedEvaluate());
+
+	if (ss->ply >= MAX_PLY - 1)
+		return eval;
+
+	if (eval >= beta)
+		return beta;
+
+	if (eval > alpha)
+		alpha = eval;
+
+	MoveList moves[1];
+	int count = 0;
+
+	STAT_TIME(genTime, GenerateMoves(moves));
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		int move = moves->moves[i].move;
+
+		if (getCapture(move))
+		{
+			moves->moves[count].move = move;
+			moves->moves[count++].score = CaptureScore(move);
+		}
+	}
+
+	moves->count = count;
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		PickMove(moves, i);
+
+		if (!MakeMove(moves->moves[i].move))
+			continue;
+
+		ss->ply++;
+		int score = -Quiescence(-beta, -alpha);
+		ss->ply--;
+
+		TakeBack();
+
+		if (sInfo->stopped)
+			return 0;
+
+		if (score >= beta)
+			return beta;
+
+		if (score > alpha)
+			alpha = score;
+	}
+
+	return alpha;
+}
+
+// root moves left out: the lines MultiPV already reported and anything go searchmoves or the
+// tablebase ranking did not name
+static inline bool IsRootExcluded(int move)
+{
+	for (int i = 0; i < ss->rootExcludedCount; i++)
+		if (ss->rootExcluded[i] == move)
+			return true;
+
+	if (!ss->searchMoveCount)
+		return false;
+
+	for (int i = 0; i < ss->searchMoveCount; i++)
+		if (ss->searchMoves[i] == move)
+			return false;
+
+	return true;
+}
+
+static inline int NegaMax(int depth, int alpha, int beta)
+{
+	ss->pvLength[ss->ply] = ss->ply;
+
+	if (ss->ply && (pos->fifty >= 100 || IsRepetition()))
+		return 0;
+
+	if (depth == 0)
+		return Quiescence(alpha, beta);
+
+	if (NodeLimitReached())
+		return 0;
+
+	if ((sInfo->nodes & 2047) == 0)
+		CheckUp();
+
+	sInfo->nodes++;
+
+	STAT(stats->nodesPerPly[ss->ply]++);
+
+	// right after a capture or pawn move the tables are exact
+	if (ss->ply && pos->fifty == 0 && TBCanProbe())
+	{
+		int result;
+		int wdl = TBProbeWDL(&result);
+
+		if (result != PROBE_FAIL)
+		{
+			if (wdl == WDL_WIN)
+				return TB_WIN_SCORE - ss->ply;
+			else if (wdl == WDL_LOSS)
+				return -TB_WIN_SCORE + ss->ply;
+
+			return wdl;
+		}
+	}
+
+	if (ss->ply >= MAX_PLY - 1)
+		return CachedEvaluate();
+
+	int hashMove = 0;
+	int score = ReadHashEntry(alpha, beta, depth, &hashMove);
+
+	if (ss->ply && score != NO_HASH_ENTRY)
+	{
+		STAT(stats->hashCutoffs++);
+		return score;
+	}
+
+	int legalMoves = 0;
+	int bestMove = 0;
+	int hashFlag = HASH_ALPHA;
+
+	// quiet moves searched without a cutoff
+	int quiets[256];
+	int quietCount = 0;
+
+	bool inCheck = InCheck();
+
+	MoveList moves[1];
+
+	STAT_TIME(genTime, GenerateMoves(moves));
+
+	ScoreMoves(moves, hashMove);
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		PickMove(moves, i);
+
+		int move = moves->moves[i].move;
+		bool quiet = !getCapture(move) && !getPromotion(move);
+
+		if (!ss->ply && IsRootExcluded(move))
+			continue;
+
+		ss->moves[ss->ply] = move;
+		ss->pieces[ss->ply] = getPiece(move);
+
+		if (!MakeMove(move))
+			continue;
+
+		legalMoves++;
+		ss->ply++;
+		score = -NegaMax(depth - 1, -beta, -alpha);
+		ss->ply--;
+
+		TakeBack();
+
+		if (sInfo->stopped)
+			return 0;
+
+		if (score >= beta)
+		{
+			STAT(stats->betaCutoffs++);
+			STAT(stats->firstMoveCutoffs += legalMoves == 1);
+
+			if (quiet)
+				UpdateQuietMove(move, depth, quiets, quietCount);
+
+			WriteHashEntry(beta, depth, HASH_BETA, move);
+			return beta;
+		}
+
+		if (quiet)
+			quiets[quietCount++] = move;
+
+		if (score > alpha)
+		{
+			alpha = score;
+			bestMove = move;
+			hashFlag = HASH_EXACT;
+
+			ss->pvTable[ss->ply][ss->ply] = move;
+
+            for (int nextPly = ss->ply + 1; nextPly < ss->pvLength[ss->ply + 1]; nextPly++)
+				ss->pvTable[ss->ply][nextPly] = ss->pvTable[ss->ply + 1][nextPly];
+
+			ss->pvLength[ss->ply] = ss->pvLength[ss->ply + 1];
+		}
+	}
+
+	if (!legalMoves)
+	{
+		if (inCheck)
+			return -MATE_VALUE + ss->ply;
+		else
+			return 0;
+	}
+
+	// a root with excluded moves is not the position the hash entry would describe
+	if (ss->ply || (!ss->rootExcludedCount && !ss->searchMoveCount))
+		WriteHashEntry(alpha, depth, hashFlag, bestMove);
+
+	return alpha;
+}
+
+static inline void Perft(int depth)
+{
+	if (depth == 0)
+	{
+		sInfo->nodes++;
+		return;
+	}
+
+	MoveList moves[1];
+	GenerateMoves(moves);
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		CopyBoard();
+
+		if (!MakeMove(moves->moves[i].move))
+			continue;
+
+		ss->ply++;
+		Perft(depth - 1);
+		ss->ply--;
+
+		TakeBack();
+	}
+}
+
+#ifdef SEARCH_STATS
+static inline double Percent(long part, long total)
+{
+	return total ? 100.0 * part / total : 0.0;
+}
+
+static inline double Ratio(long a, long b)
+{
+	return b ? (double)a / b : 0.0;
+}
+
+void PrintStats(int depth)
+{
+	char line[512];
+
+	snprintf(line, sizeof(line), "info string stats depth %d qnodes %.1f%% hashhits %.1f%% hashcuts %.1f%% evalhits %.1f%% firstcut %.1f%% ebf %.2f illegal %.1f%% gen %.1fms eval %.1fms",
+		depth, Percent(stats->qnodes, sInfo->nodes), Percent(stats->hashHits, stats->hashProbes),
+		Percent(stats->hashCutoffs, stats->hashProbes), Percent(stats->evalHits, stats->evalProbes), Percent(stats->firstMoveCutoffs, stats->betaCutoffs),
+		depth > 1 ? Ratio(stats->iterationNodes[depth], stats->iterationNodes[depth - 1]) : 0.0,
+		Percent(stats->illegalMoves, stats->moves), stats->genTime / 1e6, stats->evalTime / 1e6);
+
+	cout << line << endl;
+}
+
+// whole search as one JSON object on stderr, out of the way of the GUI
+void DumpStats(int depth)
+{
+	cerr << "{\"nodes\":" << sInfo->nodes << ",\"qnodes\":" << stats->qnodes
+		<< ",\"hashProbes\":" << stats->hashProbes << ",\"hashHits\":" << stats->hashHits << ",\"hashCutoffs\":" << stats->hashCutoffs
+		<< ",\"evalProbes\":" << stats->evalProbes << ",\"evalHits\":" << stats->evalHits
+		<< ",\"betaCutoffs\":" << stats->betaCutoffs << ",\"firstMoveCutoffs\":" << stats->firstMoveCutoffs
+		<< ",\"moves\":" << stats->moves << ",\"illegalMoves\":" << stats->illegalMoves
+		<< ",\"genTimeNs\":" << stats->genTime << ",\"evalTimeNs\":" << stats->evalTime;
+
+	cerr << ",\"iterationNodes\":[";
+
+	for (int i = 1; i <= depth; i++)
+		cerr << (i > 1 ? "," : "") << stats->iterationNodes[i];
+
+	cerr << "],\"nodesPerPly\":[";
+
+	for (int i = 0; i < MAX_PLY && stats->nodesPerPly[i]; i++)
+		cerr << (i ? "," : "") << stats->nodesPerPly[i];
+
+	cerr << "]}" << endl;
+}
+#endif
+
+// UCI score field, "cp <x>" or "mate <moves>"
+string ScoreString(int score)
+{
+	if (score < -MATE_SCORE)
+		return "mate " + to_string(-(MATE_VALUE + score) / 2);
+	else if (score > MATE_SCORE)
+		return "mate " + to_string((MATE_VALUE - score + 1) / 2);
+
+	return "cp " + to_string(score);
+}
+
+// the hash move of the position after move, for a ponder move when a hash cut shortened the pv
+int HashReply(int move)
+{
+	int reply = 0;
+
+	if (!move || !MakeMove(move))
+		return 0;
+
+	ss->ply++;
+
+	HashEntry *entry = HashBucketFor(pos->hashKey)->entries;
+
+	for (int i = 0; i < HASH_BUCKET_SIZE; i++)
+		if (entry[i].key == pos->hashKey)
+			reply = entry[i].move;
+
+	// a stored move is only a hint, it has to be one of the legal moves here
+	if (reply)
+	{
+		MoveList moves[1];
+		int legal = 0;
+
+		GenerateMoves(moves);
+
+		for (int i = 0; i < moves->count && !legal; i++)
+		{
+			if (moves->moves[i].move == reply && MakeMove(reply))
+			{
+				legal = 1;
+				TakeBack();
+			}
+		}
+
+		if (!legal)
+			reply = 0;
+	}
+
+	ss->ply--;
+	TakeBack();
+
+	return reply;
+}
+
+void PrintSearchInfo(int depth, int line, RootLine *root)
+{
+	cout << "info depth " << depth;
+
+	// a single line keeps the plain format older tools parse
+	if (sInfo->multiPV > 1)
+		cout << " multipv " << line;
+
+	cout << " score " << ScoreString(root->score) << " nodes " << sInfo->nodes << " time " << getTimeMS() - sInfo->starttime << " pv ";
+
+	for (int i = 0; i < root->length; i++)
+	{
+		PrintMove(root->pv[i]);
+		cout << " ";
+	}
+
+	cout << endl;
+}
+
+static int CountRootMoves()
+{
+	int count = 0;
+	MoveList moves[1];
+
+	GenerateMoves(moves);
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		if (!IsRootExcluded(moves->moves[i].move) && MakeMove(moves->moves[i].move))
+		{
+			count++;
+			TakeBack();
+		}
+	}
+
+	return count;
+}
+
+// what a search stopped before its first iteration plays, 0 when there is no legal move
+static int FirstRootMove()
+{
+	MoveList moves[1];
+
+	GenerateMoves(moves);
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		if (!IsRootExcluded(moves->moves[i].move) && MakeMove(moves->moves[i].move))
+		{
+			TakeBack();
+			return moves->moves[i].move;
+		}
+	}
+
+	return 0;
+}
+
+// forgets what move ordering learnt, for a new game or a position that must not depend on earlier ones
+void ClearHistory()
+{
+	memset(ss->history, 0, sizeof(ss->history));
+	memset(ss->counterMoves, 0, sizeof(ss->counterMoves));
+	memset(ss->continuation, 0, sizeof(ss->continuation));
+}
+
+void SearchPosition(int depth)
+{
+	int score = 0;
+	int bestMove = 0;
+	int ponderMove = 0;
+
+	sInfo->nodes = 0;
+	sInfo->stopped = 0;
+	sInfo->bestScore = 0;
+
+	// entries of earlier searches, and of earlier sessions in a hash file, make way first
+	hashTable->header->age = (hashTable->header->age + 1) & HASH_AGE_MASK;
+
+	ss->ply = 0;
+	ss->rootExcludedCount = 0;
+
+	memset(ss->pvTable, 0, sizeof(ss->pvTable));
+	memset(ss->killers, 0, sizeof(ss->killers));
+	memset(ss->pvLength, 0, sizeof(ss->pvLength));
+
+	// the ordering tables carry over from the previous move, the small butterfly table decays
+	// so it follows the game, counter moves and continuation history only change on a new game
+	for (int piece = P; piece <= k; piece++)
+		for (int sq = 0; sq < 64; sq++)
+			ss->history[piece][sq] /= 2;
+
+	STAT(memset(stats, 0, sizeof(*stats)));
+
+	int lines = sInfo->multiPV > 1 ? min(sInfo->multiPV, CountRootMoves()) : 1;
+	int currentDepth;
+
+	for (currentDepth = 1; currentDepth <= depth; currentDepth++)
+	{
+		STAT(stats->iterationNodes[currentDepth] = sInfo->nodes);
+
+		// line by line, the table keeps what the earlier lines learnt about the shared subtrees
+		for (int line = 0; line < lines && !sInfo->stopped; line++)
+		{
+			ss->rootExcludedCount = line;
+
+			score = NegaMax(currentDepth, -INF, INF);
+
+			// an interrupted line leaves a partial pv behind, keep the last complete one
+			if (sInfo->stopped)
+				break;
+
+			RootLine *root = &ss->rootLines[line];
+
+			root->score = score;
+			root->length = ss->pvLength[0];
+			memcpy(root->pv, ss->pvTable[0], root->length * sizeof(root->pv[0]));
+
+			ss->rootExcluded[line] = root->pv[0];
+		}
+
+		ss->rootExcludedCount = 0;
+
+		// a later line can outscore an earlier one when its search saw more, GUIs read multipv 1 as the best
+		if (!sInfo->stopped)
+		{
+			stable_sort(ss->rootLines, ss->rootLines + lines, [](const RootLine &a, const RootLine &b) { return a.score > b.score; });
+
+			RootLine *best = &ss->rootLines[0];
+
+			// the progress callback and the final fallback read the best line from the pv table
+			ss->pvLength[0] = best->length;
+			memcpy(ss->pvTable[0], best->pv, best->length * sizeof(best->pv[0]));
+
+			bestMove = best->pv[0];
+			ponderMove = best->length > 1 ? best->pv[1] : 0;
+			sInfo->bestScore = best->score;
+
+			if (sInfo->progress)
+				sInfo->progress(currentDepth, best->score, sInfo->progressData);
+
+			for (int line = 0; sInfo->uci && line < lines; line++)
+				PrintSearchInfo(currentDepth, line + 1, &ss->rootLines[line]);
+		}
+
+		STAT(stats->iterationNodes[currentDepth] = sInfo->nodes - stats->iterationNodes[currentDepth]);
+
+		if (sInfo->stopped)
+			break;
+
+		if (!sInfo->uci)
+			continue;
+
+		STAT(PrintStats(currentDepth));
+	}
+
+	if (!bestMove)
+		bestMove = ss->pvTable[0][0];
+
+	// a node limit can stop the search before any root move was searched to the end
+	if (!bestMove)
+		bestMove = FirstRootMove();
+
+	sInfo->bestMove = bestMove;
+
+	if (!sInfo->uci)
+		return;
+
+	STAT(DumpStats(min(currentDepth, depth)));
+
+	// a search that ran out of depth still owes the GUI its wait for ponderhit or stop
+	while ((sInfo->ponder || sInfo->infinite) && !sInfo->stopped && !sInfo->quit)
+		if (InputWaiting(100))
+			ReadInput();
+
+	if (!ponderMove)
+		ponderMove = HashReply(bestMove);
+
+	cout << "bestmove ";
+	PrintMove(bestMove);
+
+	if (ponderMove)
+	{
+		cout << " ponder ";
+		PrintMove(ponderMove);
+	}
+
+	cout << endl;
+}
+
+uint64_t generateHashKey(Position *pos)
+{
+	uint64_t finalKey = 0ULL;
+	uint64_t bb = 0ULL;
+		
+	int sq = 0;
+		
+	for (int piece = P; piece <= k; piece++)
+	{
+		bb = pos->bb[piece];
+			
+		while (bb)
+		{
+			sq = GetLSB(bb);
+			finalKey ^= zobrist[piece][sq];
+			popBit(bb, sq);
+		}
+	}
+		
+	if (pos->ep != noSq)
+		finalKey ^= epKeys[pos->ep];
+			
+	finalKey ^= castleKeys[pos->ca];
+		
+	if(pos->side == BLACK)
+		finalKey ^= sideKey;
+		
+	return finalKey;
+}
+
+// what makes pos unplayable, or NULL: the checks a FEN cannot express by its syntax alone
+const char *PositionError(Position *pos)
+{
+	if (CountBits(pos->bb[K]) != 1 || CountBits(pos->bb[k]) != 1)
+		return "each side needs exactly one king";
+
+	if ((pos->bb[P] | pos->bb[p]) & (RANK_8 | RANK_1))
+		return "pawn on the first or last rank";
+
+	if (((pos->ca & (WK | WQ)) && pos->mailbox[e1] != K) || ((pos->ca & WK) && pos->mailbox[h1] != R)
+		|| ((pos->ca & WQ) && pos->mailbox[a1] != R) || ((pos->ca & (BK | BQ)) && pos->mailbox[e8] != k)
+		|| ((pos->ca & BK) && pos->mailbox[h8] != r) || ((pos->ca & BQ) && pos->mailbox[a8] != r))
+		return "castling rights without the king and rook on their squares";
+
+	// the pawn that just moved two squares stands in front of the square, which it passed
+	if (pos->ep != noSq)
+	{
+		int pushed = pos->side == WHITE ? pos->ep + 8 : pos->ep - 8;
+		int from = pos->side == WHITE ? pos->ep - 8 : pos->ep + 8;
+		uint64_t rank = pos->side == WHITE ? RANK_6 : RANK_3;
+
+		if (!getBit(rank, pos->ep) || pos->mailbox[pushed] != (pos->side == WHITE ? p : P)
+			|| pos->mailbox[pos->ep] != NO_PIECE || pos->mailbox[from] != NO_PIECE)
+			return "en passant square without a pawn that just moved two squares";
+	}
+
+	int us = pos->side == WHITE ? P : p;
+	int king = GetLSB(pos->bb[pos->side == WHITE ? k : K]);
+
+	if ((pawnAttacks[pos->side ^ 1][king] & pos->bb[us]) | (knightAttacks[king] & pos->bb[us + N])
+		| (kingAttacks[king] & pos->bb[us + K])
+		| (GetBishopAttacks(king, pos->occ[BOTH]) & (pos->bb[us + B] | pos->bb[us + Q]))
+		| (GetRookAttacks(king, pos->occ[BOTH]) & (pos->bb[us + R] | pos->bb[us + Q])))
+		return "the side not to move is in check";
+
+	return NULL;
+}
+
+// fields end at any whitespace, a FEN from a UCI line still has its line ending
+static inline bool FenSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline const char *ParseCounter(const char *&fen, int &value)
+{
+	value = 0;
+
+	while (*fen >= '0' && *fen <= '9')
+	{
+		value = value * 10 + *fen++ - '0';
+
+		if (value > MAX_FEN_COUNTER)
+			return "move counter out of range";
+	}
+
+	return NULL;
+}
+
+// one pass over the fields, the board and castling letters go through fenTables
+static const char *ParseFenFields(Position *pos, const char *fen)
+{
+	const char *error = NULL;
+	int square = 0;
+	int rank = 0;
+
+	pos->reset();
+
+	while (FenSpace(*fen))
+		fen++;
+
+	for (; *fen && !FenSpace(*fen); fen++)
+	{
+		int piece = fenTables.piece[(uint8_t)*fen];
+
+		if (*fen == '/')
+		{
+			if (square != ++rank * 8 || rank > 7)
+				return "board without 8 ranks of 8 squares";
+		}
+		else if (*fen >= '1' && *fen <= '8')
+			square += *fen - '0';
+		else if (piece == NO_PIECE)
+			return "invalid character in the board";
+		else if (square < rank * 8 + 8)
+		{
+			setBit(pos->bb[piece], square);
+			pos->hashKey ^= zobrist[piece][square];
+			pos->mailbox[square++] = piece;
+			continue;
+		}
+		else
+			square++;
+
+		if (square > rank * 8 + 8)
+			return "board without 8 ranks of 8 squares";
+	}
+
+	if (rank != 7 || square != 64)
+		return "board without 8 ranks of 8 squares";
+
+	while (FenSpace(*fen))
+		fen++;
+
+	if ((*fen != 'w' && *fen != 'b') || (fen[1] && !FenSpace(fen[1])))
+		return "side to move is not w or b";
+
+	pos->side = *fen++ == 'w' ? WHITE : BLACK;
+
+	while (FenSpace(*fen))
+		fen++;
+
+	// a missing castling or en passant field reads as "-", as the old parser did
+	if (*fen == '-')
+		fen++;
+
+	for (; *fen && !FenSpace(*fen); fen++)
+	{
+		int right = fenTables.castling[(uint8_t)*fen];
+
+		if (!right || (pos->ca & right))
+			return "invalid castling rights";
+
+		pos->ca |= right;
+	}
+
+	while (FenSpace(*fen))
+		fen++;
+
+	if (*fen == '-')
+		fen++;
+	else if (fen[0] >= 'a' && fen[0] <= 'h' && fen[1] >= '1' && fen[1] <= '8')
+	{
+		pos->ep = ('8' - fen[1]) * 8 + fen[0] - 'a';
+		fen += 2;
+	}
+	else if (*fen)
+		return "invalid en passant square";
+
+	if (*fen && !FenSpace(*fen))
+		return "invalid en passant square";
+
+	// the counters are optional as in EPD, whatever follows the last field is not read
+	while (FenSpace(*fen))
+		fen++;
+
+	if ((error = ParseCounter(fen, pos->fifty)))
+		return error;
+
+	while (FenSpace(*fen))
+		fen++;
+
+	if ((error = ParseCounter(fen, pos->fullmove)))
+		return error;
+
+	pos->fullmove = max(1, pos->fullmove);
+
+	for (int piece = P; piece <= K; piece++)
+		pos->occ[WHITE] |= pos->bb[piece];
+
+	for (int piece = p; piece <= k; piece++)
+		pos->occ[BLACK] |= pos->bb[piece];
+
+	pos->occ[BOTH] = pos->occ[WHITE] | pos->occ[BLACK];
+
+	// the piece keys went in as the board was read
+	pos->hashKey ^= (pos->ep != noSq ? epKeys[pos->ep] : 0) ^ castleKeys[pos->ca] ^ (pos->side == BLACK ? sideKey : 0);
+
+	return NULL;
+}
+
+// false when the FEN is malformed or the position unplayable, pos is then left empty
+// and error, when given, points at a static message
+bool ParseFen(Position *pos, const char *fen, const char **error = NULL)
+{
+	const char *problem = ParseFenFields(pos, fen);
+
+	if (!problem)
+		problem = PositionError(pos);
+
+	if (problem)
+	{
+		pos->reset();
+
+		if (error)
+			*error = problem;
+
+		return false;
+	}
+
+	return true;
+}
+
+// returns 0 when the move string is not a legal move in the current position
+int ParseMove(char *moveString)
+{
+	MoveList moves[1];
+	GenerateMoves(moves);
+
+	int source = (moveString[0] - 'a') + (8 - (moveString[1] - '0')) * 8;
+	int target = (moveString[2] - 'a') + (8 - (moveString[3] - '0')) * 8;
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		int move = moves->moves[i].move;
+
+		if (source != getSource(move) || target != getTarget(move))
+			continue;
+
+		if (getPromotion(move) && "nbrq"[getFlag(move) & 3] != moveString[4])
+			continue;
+
+		return move;
+	}
+
+	return 0;
+}
+
+// SAN as in PGN (Nbd7, exd6, e8=Q+, O-O) or long algebraic (g1f3, e7-e8q), returns 0 when no
+// move or more than one legal move fits; a single pseudo-legal fit is returned for the caller's
+// MakeMove to settle, like ParseMove does
+int ParseSan(const char *san, int length)
+{
+	int piece = -1;
+	int promotion = -1;
+	int sourceFile = -1;
+	int sourceRank = -1;
+
+	while (length && strchr("+#!?", san[length - 1]))
+		length--;
+
+	MoveList moves[1];
+	GenerateMoves(moves);
+
+	// castling is written by the king's side, O or 0 both occur in the wild
+	if (length >= 3 && (san[0] == 'O' || san[0] == '0'))
+	{
+		int flag = length >= 5 ? QUEEN_CASTLE : KING_CASTLE;
+
+		for (int i = 0; i < moves->count; i++)
+			if (getFlag(moves->moves[i].move) == flag)
+				return moves->moves[i].move;
+
+		return 0;
+	}
+
+	if (length >= 2 && strchr("NBRQnbrq", san[length - 1]) && (san[length - 2] == '=' || isdigit(san[length - 2])))
+	{
+		promotion = strchr("nbrq", tolower(san[length - 1])) - "nbrq";
+		length -= san[length - 2] == '=' ? 2 : 1;
+	}
+
+	if (length && strchr("NBRQK", san[0]))
+	{
+		piece = strchr("PNBRQK", san[0]) - "PNBRQK";
+		san++;
+		length--;
+	}
+
+	if (length < 2 || san[length - 2] < 'a' || san[length - 2] > 'h' || san[length - 1] < '1' || san[length - 1] > '8')
+		return 0;
+
+	int target = (san[length - 2] - 'a') + (8 - (san[length - 1] - '0')) * 8;
+
+	// whatever stands between the piece and the target square: a source file, rank, x or -
+	for (int i = 0; i < length - 2; i++)
+	{
+		if (san[i] >= 'a' && san[i] <= 'h')
+			sourceFile = san[i] - 'a';
+		else if (san[i] >= '1' && san[i] <= '8')
+			sourceRank = 8 - (san[i] - '0');
+		else if (san[i] != 'x' && san[i] != '-' && san[i] != ':')
+			return 0;
+	}
+
+	// a bare pawn move names no piece, long algebraic names none for any piece
+	if (piece < 0 && (sourceFile < 0 || sourceRank < 0))
+		piece = P;
+
+	int found = 0;
+	int candidates[256];
+	int count = 0;
+
+	for (int i = 0; i < moves->count; i++)
+	{
+		int move = moves->moves[i].move;
+		int source = getSource(move);
+
+		if (getTarget(move) != target || (piece >= 0 && getPiece(move) % 6 != piece))
+			continue;
+
+		if ((sourceFile >= 0 && source % 8 != sourceFile) || (sourceRank >= 0 && source / 8 != sourceRank))
+			continue;
+
+		if (getPromotion(move) ? (getFlag(move) & 3) != promotion : promotion >= 0)
+			continue;
+
+		candidates[count++] = move;
+	}
+
+	if (count == 1)
+		return candidates[0];
+
+	// SAN leaves out a disambiguation a pinned piece makes unnecessary
+	for (int i = 0; i < count; i++)
+	{
+		if (MakeMove(candidates[i]))
+		{
+			TakeBack();
+
+			if (found)
+				return 0;
+
+			found = candidates[i];
+		}
+	}
+
+	return found;
+}
+
+void CloseBook()
+{
+	if (book->entries)
+		munmap((void *)book->entries, book->size);
+
+	book->entries = NULL;
+	book->count = 0;
+	book->size = 0;
+}
+
+// the file is mapped read-only and shared, so engines on one host keep a single copy in the page cache
+bool OpenBook(const char *path)
+{
+	struct stat st;
+
+	CloseBook();
+
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0 || st.st_size < 16)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	madvise(data, st.st_size, MADV_RANDOM);
+
+	book->entries = (const unsigned char *)data;
+	book->size = st.st_size;
+	book->count = st.st_size / 16;
+
+	return true;
+}
+
+// Polyglot numbers ranks from white's side and interleaves the colours, black pawn first
+uint64_t PolyglotKey(Position *pos)
+{
+	uint64_t key = 0ULL;
+	uint64_t bb = 0ULL;
+
+	for (int piece = P; piece <= k; piece++)
+	{
+		int kind = 2 * (piece % 6) + (piece < p);
+
+		bb = pos->bb[piece];
+
+		while (bb)
+		{
+			int sq = GetLSB(bb);
+			key ^= polyglotRandom[64 * kind + (sq ^ 56)];
+			popBit(bb, sq);
+		}
+	}
+
+	if (pos->ca & WK) key ^= polyglotRandom[768];
+	if (pos->ca & WQ) key ^= polyglotRandom[769];
+	if (pos->ca & BK) key ^= polyglotRandom[770];
+	if (pos->ca & BQ) key ^= polyglotRandom[771];
+
+	// the enpassant file only counts when a pawn can actually capture
+	if (pos->ep != noSq && (pawnAttacks[pos->side ^ 1][pos->ep] & pos->bb[pos->side == WHITE ? P : p]))
+		key ^= polyglotRandom[772 + pos->ep % 8];
+
+	if (pos->side == WHITE)
+		key ^= polyglotRandom[780];
+
+	return key;
+}
+
+// returns a legal book move for the current position or 0
+int ProbeBook()
+{
+	if (!book->entries)
+		return 0;
+
+	uint64_t key = PolyglotKey(pos);
+
+	// binary search for the first entry of this position
+	size_t low = 0, high = book->count;
+
+	while (low < high)
+	{
+		size_t mid = (low + high) / 2;
+
+		if (ReadBigEndian(book->entries + mid * 16, 8) < key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	int moves[256];
+	int weights[256];
+	int count = 0;
+	int total = 0;
+
+	for (size_t i = low; i < book->count && count < 256; i++)
+	{
+		const unsigned char *entry = book->entries + i * 16;
+
+		if (ReadBigEndian(entry, 8) != key)
+			break;
+
+		int bookMove = ReadBigEndian(entry + 8, 2);
+		int weight = ReadBigEndian(entry + 10, 2);
+
+		int toFile = bookMove & 7;
+		int toRank = (bookMove >> 3) & 7;
+		int fromFile = (bookMove >> 6) & 7;
+		int fromRank = (bookMove >> 9) & 7;
+		int promoted = (bookMove >> 12) & 7;
+
+		// castling is stored as the king capturing its own rook
+		if (fromFile == 4 && (fromRank == 0 || fromRank == 7) && (toFile == 0 || toFile == 7) && toRank == fromRank &&
+			getBit(pos->bb[pos->side == WHITE ? K : k], (7 - fromRank) * 8 + 4))
+			toFile = (toFile == 7) ? 6 : 2;
+
+		char moveString[6] = {
+			(char)('a' + fromFile), (char)('1' + fromRank),
+			(char)('a' + toFile), (char)('1' + toRank),
+			promoted ? " nbrq"[promoted] : '\0', '\0'
+		};
+
+		int move = ParseMove(moveString);
+
+		if (!move || !weight)
+			continue;
+
+		moves[count] = move;
+		weights[count] = weight;
+		total += weight;
+		count++;
+	}
+
+	if (!count)
+		return 0;
+
+	int best = 0;
+
+	if (book->bestMove)
+	{
+		for (int i = 1; i < count; i++)
+			if (weights[i] > weights[best])
+				best = i;
+	}
+	else
+	{
+		uint64_t &seed = sInfo->bookSeed;
+
+		if (!seed)
+			seed = 0x2545F4914F6CDD1DULL ^ ((uint64_t)getpid() << 32) ^ (uint32_t)getTimeMS() ^ (uintptr_t)sInfo;
+
+		// xorshift, weighted by the entry weights
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		int pick = seed % total;
+
+		while (pick >= weights[best])
+			pick -= weights[best++];
+	}
+
+	// a key collision can hand us a move that leaves the king in check
+	if (!MakeMove(moves[best]))
+		return 0;
+
+	TakeBack();
+
+	return moves[best];
+}
+
+// a long game keeps only the keys a repetition can still reach, the search needs the room above them
+void TrimHistory()
+{
+	int keep = min(min(pos->fifty, pos->histPly), 100);
+
+	memmove(pos->hashHistory, pos->hashHistory + pos->histPly - keep, keep * sizeof(uint64_t));
+	pos->histPly = keep;
+}
+
+// position [startpos | fen <fen>] [moves <move1> ... <moveN>]
+void ParsePosition(char *command)
+{
+	command += 9;
+
+	char *current = strstr(command, "fen");
+
+	const char *error = NULL;
+
+	if (!strncmp(command, "startpos", 8) || current == NULL)
+		ParseFen(pos, startPosition);
+	else if (!ParseFen(pos, current + 4, &error))
+	{
+		// the moves belong to the rejected position, none of them can be played
+		cout << "info string invalid fen: " << error << endl;
+		ParseFen(pos, startPosition);
+		return;
+	}
+
+	current = strstr(command, "moves");
+
+	if (current == NULL)
+		return;
+
+	current += 6;
+
+	// game moves are made at ply 0 so their keys stay in the repetition history
+	while (*current)
+	{
+		if (pos->histPly >= MAX_GAME_PLY - MAX_PLY)
+			TrimHistory();
+
+		int move = ParseMove(current);
+
+		if (!move || !MakeMove(move))
+			break;
+
+		while (*current && *current != ' ')
+			current++;
+
+		while (*current == ' ')
+			current++;
+	}
+}
+
+// go searchmoves <move1> ... <moveN>, the list ends at the first word that is not a legal move
+void ParseSearchMoves(char *command)
+{
+	char *current = strstr(command, "searchmoves");
+
+	ss->searchMoveCount = 0;
+
+	if (!current)
+		return;
+
+	current += 11;
+
+	while (*current == ' ')
+		current++;
+
+	while (*current && ss->searchMoveCount < 256)
+	{
+		int move = strlen(current) >= 4 ? ParseMove(current) : 0;
+
+		if (!move || !MakeMove(move))
+			break;
+
+		TakeBack();
+
+		ss->searchMoves[ss->searchMoveCount++] = move;
+
+		while (*current && *current != ' ')
+			current++;
+
+		while (*current == ' ')
+			current++;
+	}
+}
+
+// go [wtime <x>] [btime <x>] [winc <x>] [binc <x>] [movestogo <x>] [movetime <x>] [depth <x>] [nodes <x>]
+//    [infinite] [ponder] [searchmoves <move1> ... <moveN>]
+void ParseGo(char *command)
+{
+	int depth = -1;
+	char *argument = NULL;
+
+	sInfo->ponder = strstr(command, " ponder") != NULL;
+	sInfo->infinite = strstr(command, " infinite") != NULL;
+
+	ParseSearchMoves(command);
+
+	// a ponder or infinite search must not answer before ponderhit or stop, a restricted one
+	// must stay within its moves and MultiPV wants more than the one line a shortcut gives
+	bool shortcut = !sInfo->ponder && !sInfo->infinite && !ss->searchMoveCount && sInfo->multiPV == 1;
+
+	if (book->enabled && shortcut)
+	{
+		int move = ProbeBook();
+
+		if (move)
+		{
+			cout << "info string book move" << endl;
+			cout << "bestmove ";
+			PrintMove(move);
+			cout << endl;
+			return;
+		}
+	}
+
+	// a single best ranked move is played at once, several are searched among themselves
+	if (TBCanProbe() && shortcut)
+	{
+		int score;
+		int count = TBRootProbe(&score);
+
+		if (count == 1)
+		{
+			int move = ss->searchMoves[0];
+
+			ss->searchMoveCount = 0;
+
+			cout << "info depth 1 score cp " << score << " nodes 0 time 0 pv ";
+			PrintMove(move);
+			cout << endl << "info string tablebase move" << endl;
+			cout << "bestmove ";
+			PrintMove(move);
+			cout << endl;
+			return;
+		}
+
+		if (count)
+			cout << "info string tablebase search over " << count << " moves" << endl;
+	}
+
+	sInfo->movestogo = 30;
+	sInfo->movetime = -1;
+	sInfo->tTime = -1;
+	sInfo->inc = 0;
+	sInfo->timeset = 0;
+	sInfo->nodeLimit = 0;
+
+	if ((argument = strstr(command, " nodes ")))
+		sInfo->nodeLimit = max(1L, atol(argument + 7));
+
+	if ((argument = strstr(command, "binc")) && pos->side == BLACK)
+		sInfo->inc = atoi(argument + 5);
+
+	if ((argument = strstr(command, "winc")) && pos->side == WHITE)
+		sInfo->inc = atoi(argument + 5);
+
+	if ((argument = strstr(command, "wtime")) && pos->side == WHITE)
+		sInfo->tTime = atoi(argument + 6);
+
+	if ((argument = strstr(command, "btime")) && pos->side == BLACK)
+		sInfo->tTime = atoi(argument + 6);
+
+	if ((argument = strstr(command, "movestogo")))
+		sInfo->movestogo = atoi(argument + 10);
+
+	if ((argument = strstr(command, "movetime")))
+		sInfo->movetime = atoi(argument + 9);
+
+	if ((argument = strstr(command, "depth")))
+		depth = atoi(argument + 6);
+
+	if (sInfo->movetime != -1)
+	{
+		sInfo->tTime = sInfo->movetime;
+		sInfo->movestogo = 1;
+	}
+
+	sInfo->starttime = getTimeMS();
+
+	if (sInfo->tTime != -1)
+	{
+		int clock = sInfo->tTime;
+
+		sInfo->timeset = 1;
+
+		sInfo->tTime /= sInfo->movestogo;
+
+		// keep a small margin for the GUI
+		if (sInfo->tTime > 100)
+			sInfo->tTime -= 50;
+
+		int budget = sInfo->tTime + sInfo->inc;
+
+		// the increment arrives after the move, a nearly empty clock cannot spend it in advance
+		if (sInfo->movetime == -1)
+			budget = min(budget, clock - min(50, clock / 2));
+
+		sInfo->stoptime = sInfo->starttime + budget;
+	}
+
+	if (depth < 1 || depth > MAX_PLY - 1)
+		depth = MAX_PLY - 1;
+
+	SearchPosition(depth);
+}
+
+// setoption name <id> [value <x>]
+void ParseSetOption(char *command)
+{
+	char *name = strstr(command, "name ");
+	char *value = strstr(command, "value ");
+
+	if (!name)
+		return;
+
+	name += 5;
+
+	if (value)
+	{
+		value[-1] = '\0';
+		value += 6;
+		value[strcspn(value, "\r\n")] = '\0';
+	}
+	else
+		name[strcspn(name, "\r\n")] = '\0';
+
+	if (!strcmp(name, "OwnBook"))
+		book->enabled = value && !strcmp(value, "true");
+	else if (!strcmp(name, "BookBestMove"))
+		book->bestMove = value && !strcmp(value, "true");
+	else if (!strcmp(name, "BookFile") && value)
+	{
+		if (OpenBook(value))
+			cout << "info string book " << value << " " << book->count << " entries" << endl;
+		else
+			cout << "info string cannot open book " << value << endl;
+	}
+	else if (!strcmp(name, "Hash") && value)
+	{
+		int previous = hashTable->mb;
+		string path = hashTable->path;
+
+		// the search needs a table, the old size is mapped again and the default size after that
+		if (!InitHash(max(1, atoi(value)), path.c_str()))
+		{
+			cout << "info string cannot allocate hash, keeping " << previous << " MB" << endl;
+
+			if (!InitHash(previous, path.c_str()))
+				InitHash(DEFAULT_HASH_MB, "");
+		}
+	}
+	else if (!strcmp(name, "HashFile"))
+	{
+		const char *path = value && strcmp(value, "<empty>") ? value : "";
+
+		if (!InitHash(hashTable->mb, path))
+		{
+			cout << "info string cannot map hash file " << path << endl;
+
+			if (!InitHash(hashTable->mb, ""))
+				InitHash(DEFAULT_HASH_MB, "");
+		}
+	}
+	else if (!strcmp(name, "MultiPV") && value)
+		sInfo->multiPV = max(1, min(MAX_MULTIPV, atoi(value)));
+	else if (!strcmp(name, "EvalCache") && value)
+	{
+		if (!InitEvalCache(max(1, atoi(value))))
+			cout << "info string cannot allocate eval cache, keeping " << evalCache->mb << " MB" << endl;
+	}
+	else if (!strcmp(name, "ClearHash"))
+		ClearHash();
+	else if (!strcmp(name, "SaveHash"))
+		SaveHash();
+	else if (!strcmp(name, "SyzygyPath"))
+		TBInit(value && strcmp(value, "<empty>") ? value : "");
+	else if (!strcmp(name, "SyzygyProbeLimit") && value)
+		syzygy->probeLimit = max(0, min(TB_PIECES, atoi(value)));
+}
+
+// positions of an EPD batch, results are written in input order as they complete
+class EpdBatch {
+public:
+	vector<string> fens;
+	vector<string> results;
+	vector<long> nodeCounts;
+	vector<char> done;
+	atomic<size_t> next{0};
+	int workers = 0;
+
+	mutex lock;
+	condition_variable ready;
+
+	int depth = MAX_PLY - 1;
+	long nodes = 0;
+	int movetime = -1;
+	int hashMB = DEFAULT_HASH_MB;
+	bool json = 0;
+};
+
+// an EPD line starts with the first four FEN fields, the move counters are optional
+string EpdToFen(const char *line)
+{
+	static char buffer[4096];
+	string fen;
+
+	snprintf(buffer, sizeof(buffer), "%s", line);
+
+	char *field = strtok(buffer, " \t\r\n");
+
+	for (int i = 0; field && i < 6; i++, field = strtok(NULL, " \t\r\n"))
+	{
+		if (i >= 4 && !isdigit(*field))
+			break;
+
+		fen += (i ? " " : "") + string(field);
+	}
+
+	return fen;
+}
+
+void EpdWorker(EpdBatch *batch)
+{
+	size_t index;
+	Engine *engine = new Engine;
+
+	BindEngine(engine);
+
+	sInfo->uci = 0;
+
+	// a worker without tables takes no positions, the others share them
+	if (!InitHash(batch->hashMB, "") || !InitEvalCache(DEFAULT_EVAL_CACHE_MB))
+	{
+		FreeHash();
+		delete engine;
+
+		lock_guard<mutex> lock(batch->lock);
+		batch->workers--;
+		batch->ready.notify_one();
+		return;
+	}
+
+	while ((index = batch->next++) < batch->fens.size())
+	{
+		// fresh tables per position keep every result independent of scheduling
+		ClearHash();
+		ClearHistory();
+		ParseFen(pos, batch->fens[index].c_str());
+
+		sInfo->starttime = getTimeMS();
+		sInfo->timeset = batch->movetime > 0;
+		sInfo->stoptime = sInfo->starttime + batch->movetime;
+		sInfo->nodeLimit = batch->nodes;
+
+		SearchPosition(batch->nodes || batch->movetime > 0 ? MAX_PLY - 1 : batch->depth);
+
+		int elapsed = getTimeMS() - sInfo->starttime;
+		string move = sInfo->bestMove ? MoveString(sInfo->bestMove) : "0000";
+		string score = ScoreString(sInfo->bestScore);
+		string result;
+
+		if (batch->json)
+			result = "{\"fen\":\"" + batch->fens[index] + "\",\"bestmove\":\"" + move + "\",\"score\":\"" + score
+				+ "\",\"nodes\":" + to_string(sInfo->nodes) + ",\"time\":" + to_string(elapsed) + "}\n";
+		else
+			result = batch->fens[index] + "," + move + "," + score + "," + to_string(sInfo->nodes) + "," + to_string(elapsed) + "\n";
+
+		lock_guard<mutex> lock(batch->lock);
+		batch->results[index] = result;
+		batch->nodeCounts[index] = sInfo->nodes;
+		batch->done[index] = 1;
+		batch->ready.notify_one();
+	}
+
+	FreeHash();
+	FreeEvalCache();
+
+	delete engine;
+
+	lock_guard<mutex> lock(batch->lock);
+	batch->workers--;
+	batch->ready.notify_one();
+}
+
+// runs every position of the batch on a pool of threads, results are written in input order;
+// false when the workers stopped short of the last position
+bool RunBatch(EpdBatch *batch, int threads, FILE *output)
+{
+	vector<thread> workers;
+
+	if (!CanAllocateHash(batch->hashMB))
+	{
+		cout << "info string cannot allocate hash of " << batch->hashMB << " MB, batch not started" << endl;
+		return false;
+	}
+
+	batch->results.resize(batch->fens.size());
+	batch->nodeCounts.resize(batch->fens.size());
+	batch->done.resize(batch->fens.size());
+
+	threads = max(1, min(threads, (int)batch->fens.size()));
+	batch->workers = threads;
+
+	for (int i = 0; i < threads; i++)
+		workers.emplace_back(EpdWorker, batch);
+
+	for (size_t i = 0; output && i < batch->fens.size(); i++)
+	{
+		unique_lock<mutex> lock(batch->lock);
+		batch->ready.wait(lock, [&] { return batch->done[i] || !batch->workers; });
+
+		if (!batch->done[i])
+			break;
+
+		fputs(batch->results[i].c_str(), output);
+		fflush(output);
+	}
+
+	for (int i = 0; i < threads; i++)
+		workers[i].join();
+
+	for (size_t i = 0; i < batch->fens.size(); i++)
+	{
+		if (!batch->done[i])
+		{
+			cout << "info string cannot allocate search tables, batch stopped at position " << i + 1 << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// analyse-epd <file> depth <n> | nodes <n> | movetime <ms> [threads <n>] [hash <mb>] [output <file.csv|file.jsonl>]
+void AnalyseEpd(char *command)
+{
+	EpdBatch batch;
+	char path[4096];
+	char outputPath[4096] = "";
+	char line[4096];
+	char *argument = NULL;
+	int threads = thread::hardware_concurrency();
+
+	if (sscanf(command, "analyse-epd %4095s", path) != 1)
+	{
+		cout << "info string usage: analyse-epd <file> depth <n> | nodes <n> | movetime <ms> [threads <n>] [hash <mb>] [output <file>]" << endl;
+		return;
+	}
+
+	if ((argument = strstr(command, " depth ")))
+		batch.depth = max(1, min(MAX_PLY - 1, atoi(argument + 7)));
+
+	if ((argument = strstr(command, " nodes ")))
+		batch.nodes = atol(argument + 7);
+
+	if ((argument = strstr(command, " movetime ")))
+		batch.movetime = atoi(argument + 10);
+
+	if ((argument = strstr(command, " threads ")))
+		threads = atoi(argument + 9);
+
+	if ((argument = strstr(command, " hash ")))
+		batch.hashMB = max(1, atoi(argument + 6));
+
+	if ((argument = strstr(command, " output ")))
+		sscanf(argument + 8, "%4095s", outputPath);
+
+	FILE *input = fopen(path, "r");
+
+	if (!input)
+	{
+		cout << "info string cannot open " << path << endl;
+		return;
+	}
+
+	// rejected here, the workers only see positions they can search
+	Position *check = new Position;
+
+	for (int lineNumber = 1; fgets(line, sizeof(line), input); lineNumber++)
+	{
+		string fen = EpdToFen(line);
+		const char *error = NULL;
+
+		if (fen.empty() || fen[0] == '#')
+			continue;
+
+		if (ParseFen(check, fen.c_str(), &error))
+			batch.fens.push_back(fen);
+		else
+			cout << "info string line " << lineNumber << " skipped, invalid fen: " << error << endl;
+	}
+
+	delete check;
+
+	fclose(input);
+
+	FILE *output = *outputPath ? fopen(outputPath, "w") : stdout;
+
+	if (!output)
+	{
+		cout << "info string cannot create " << outputPath << endl;
+		return;
+	}
+
+	batch.json = strlen(outputPath) > 6 && !strcmp(outputPath + strlen(outputPath) - 6, ".jsonl");
+
+	if (!batch.json)
+		fputs("fen,bestmove,score,nodes,time\n", output);
+
+	RunBatch(&batch, threads, output);
+
+	if (output != stdout)
+		fclose(output);
+}
+
+// bench [depth] [threads] [hashMB], the node total is a signature of the search
+void Bench(char *command)
+{
+	EpdBatch batch;
+	int threads = 1;
+	long nodes = 0;
+
+	batch.depth = BENCH_DEPTH;
+	sscanf(command, "bench %d %d %d", &batch.depth, &threads, &batch.hashMB);
+
+	batch.depth = max(1, min(MAX_PLY - 1, batch.depth));
+	batch.hashMB = max(1, batch.hashMB);
+
+	for (int i = 0; benchPositions[i]; i++)
+		batch.fens.push_back(benchPositions[i]);
+
+	int start = getTimeMS();
+
+	if (!RunBatch(&batch, threads, NULL))
+		return;
+
+	int elapsed = max(1, getTimeMS() - start);
+
+	for (size_t i = 0; i < batch.nodeCounts.size(); i++)
+		nodes += batch.nodeCounts[i];
+
+	cout << "positions " << batch.fens.size() << " depth " << batch.depth << " threads " << threads << " hash " << batch.hashMB << endl;
+	cout << "time " << elapsed << " ms" << endl;
+	cout << "nodes " << nodes << endl;
+	cout << "nps " << nodes * 1000 / elapsed << endl;
+}
+
+// one training position, 32 bytes little-endian: pieces[] holds a 4-bit piece code per
+// occupied square in square order (a8 = 0), the low nibble first
+class PackedPosition {
+public:
+	uint64_t occupancy;
+	uint8_t pieces[16];
+	int16_t score;      // centipawns from white's point of view
+	uint8_t result;     // 0 black wins, 1 draw, 2 white wins
+	uint8_t side;
+	uint8_t ep;         // noSq when there is none
+	uint8_t castling;
+	uint8_t fifty;
+	uint8_t reserved;
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition is a fixed record size");
+
+// self-play games shared out to the workers, every worker appends to its own shard
+class DatagenBatch {
+public:
+	atomic<long> next{0};
+	atomic<long> gamesDone{0};
+	atomic<long> positions{0};
+	atomic<int> running{0};
+
+	long games = 0;
+	long nodes = DATAGEN_NODES;
+	int randomPlies = DATAGEN_RANDOM_PLIES;
+	int hashMB = DEFAULT_HASH_MB;
+	uint64_t seed = ZOBRIST_SEED;
+	string prefix = "datagen";
+};
+
+void PackPosition(PackedPosition *packed, int score)
+{
+	uint64_t bb = pos->occ[BOTH];
+
+	memset(packed, 0, sizeof(*packed));
+
+	packed->occupancy = bb;
+
+	for (int i = 0; bb; i++)
+	{
+		int sq = GetLSB(bb);
+
+		packed->pieces[i / 2] |= pos->mailbox[sq] << (i & 1 ? 4 : 0);
+		popBit(bb, sq);
+	}
+
+	packed->score = pos->side == WHITE ? score : -score;
+	packed->side = pos->side;
+	packed->ep = pos->ep;
+	packed->castling = pos->ca;
+	packed->fifty = min(pos->fifty, 255);
+}
+
+// plays uniformly random legal moves from the start position, false when the game ended on the way
+bool PlayRandomOpening(int plies, uint64_t &seed)
+{
+	ParseFen(pos, startPosition);
+
+	for (int ply = 0; ply < plies; ply++)
+	{
+		MoveList moves[1];
+		int legal[256];
+		int legalCount = 0;
+
+		GenerateMoves(moves);
+
+		for (int i = 0; i < moves->count; i++)
+		{
+			if (MakeMove(moves->moves[i].move))
+			{
+				legal[legalCount++] = moves->moves[i].move;
+				TakeBack();
+			}
+		}
+
+		if (!legalCount)
+			return false;
+
+		seed ^= seed >> 12;
+		seed ^= seed << 25;
+		seed ^= seed >> 27;
+
+		MakeMove(legal[(seed * 0x2545F4914F6CDD1DULL) % legalCount]);
+	}
+
+	return HasLegalMove();
+}
+
+// result of the game from white's point of view once it is over, -1 while it goes on
+int GameResult(int plies)
+{
+	int winner = pos->side == WHITE ? 2 : 0;
+
+	if (!HasLegalMove())
+		return InCheck() ? 2 - winner : 1;
+
+	if (pos->fifty >= 100 || IsRepetition() || plies >= GAME_MAX_PLIES)
+		return 1;
+
+	if (pos->fifty == 0 && TBCanProbe())
+	{
+		int result;
+		int wdl = TBProbeWDL(&result);
+
+		if (result != PROBE_FAIL)
+			return wdl == WDL_WIN ? winner : wdl == WDL_LOSS ? 2 - winner : 1;
+	}
+
+	return -1;
+}
+
+void DatagenWorker(DatagenBatch *batch, int shard)
+{
+	long index;
+	Engine *engine = new Engine;
+	vector<PackedPosition> game;
+	vector<char> buffer(1 << 20);
+
+	string path = batch->prefix + "-" + to_string(shard) + ".bin";
+	FILE *output = fopen(path.c_str(), "ab");
+
+	if (!output)
+	{
+		cout << "info string cannot open " << path << endl;
+		batch->running--;
+		delete engine;
+		return;
+	}
+
+	setvbuf(output, buffer.data(), _IOFBF, buffer.size());
+
+	BindEngine(engine);
+
+	sInfo->uci = 0;
+
+	if (!InitHash(batch->hashMB, "") || !InitEvalCache(DEFAULT_EVAL_CACHE_MB))
+	{
+		cout << "info string cannot allocate search tables for " << path << endl;
+		fclose(output);
+		FreeHash();
+		delete engine;
+		batch->running--;
+		return;
+	}
+
+	while ((index = batch->next++) < batch->games)
+	{
+		// the opening depends only on the seed and the game number, not on scheduling
+		uint64_t seed = batch->seed ^ (index + 1) * 0x9E3779B97F4A7C15ULL;
+		int result = -1;
+
+		while (!PlayRandomOpening(batch->randomPlies, seed))
+			;
+
+		ClearHash();
+		ClearHistory();
+		game.clear();
+
+		for (int plies = 0; (result = GameResult(plies)) < 0; plies++)
+		{
+			sInfo->starttime = getTimeMS();
+			sInfo->timeset = 0;
+			sInfo->nodeLimit = batch->nodes;
+
+			SearchPosition(MAX_PLY - 1);
+
+			int move = sInfo->bestMove;
+			int score = sInfo->bestScore;
+
+			// adjudicated for the side that is far enough ahead
+			if (abs(score) >= DATAGEN_WIN_SCORE)
+			{
+				result = (score > 0) == (pos->side == WHITE) ? 2 : 0;
+				break;
+			}
+
+			// quiet positions only: the label should be what the evaluation can see
+			if (!InCheck() && !getCapture(move) && !getPromotion(move))
+			{
+				game.emplace_back();
+				PackPosition(&game.back(), score);
+			}
+
+			ss->ply = 0;
+			MakeMove(move);
+		}
+
+		for (size_t i = 0; i < game.size(); i++)
+			game[i].result = result;
+
+		fwrite(game.data(), sizeof(PackedPosition), game.size(), output);
+
+		batch->positions += game.size();
+		batch->gamesDone++;
+	}
+
+	fclose(output);
+
+	FreeHash();
+	FreeEvalCache();
+
+	delete engine;
+
+	batch->running--;
+}
+
+// datagen <games> [nodes <n>] [threads <n>] [hash <mb>] [random <plies>] [seed <n>] [output <prefix>]
+void Datagen(char *command)
+{
+	DatagenBatch batch;
+	char prefix[4096];
+	char *argument = NULL;
+	int threads = thread::hardware_concurrency();
+	vector<thread> workers;
+
+	if (sscanf(command, "datagen %ld", &batch.games) != 1 || batch.games < 1)
+	{
+		cout << "info string usage: datagen <games> [nodes <n>] [threads <n>] [hash <mb>] [random <plies>] [seed <n>] [output <prefix>]" << endl;
+		return;
+	}
+
+	if ((argument = strstr(command, " nodes ")))
+		batch.nodes = max(1L, atol(argument + 7));
+
+	if ((argument = strstr(command, " threads ")))
+		threads = atoi(argument + 9);
+
+	if ((argument = strstr(command, " hash ")))
+		batch.hashMB = max(1, atoi(argument + 6));
+
+	if ((argument = strstr(command, " random ")))
+		batch.randomPlies = max(0, atoi(argument + 8));
+
+	if ((argument = strstr(command, " seed ")))
+		batch.seed = strtoull(argument + 6, NULL, 10);
+
+	if ((argument = strstr(command, " output ")) && sscanf(argument + 8, "%4095s", prefix) == 1)
+		batch.prefix = prefix;
+
+	threads = max(1, (int)min((long)threads, batch.games));
+
+	if (!CanAllocateHash(batch.hashMB))
+	{
+		cout << "info string cannot allocate hash of " << batch.hashMB << " MB, datagen not started" << endl;
+		return;
+	}
+
+	int start = getTimeMS();
+
+	batch.running = threads;
+
+	for (int i = 0; i < threads; i++)
+		workers.emplace_back(DatagenWorker, &batch, i);
+
+	// progress every ten seconds, the workers only touch the counters
+	for (int seconds = 1; batch.running; seconds++)
+	{
+		this_thread::sleep_for(chrono::seconds(1));
+
+		if (seconds % 10 == 0)
+			cout << "info string datagen games " << batch.gamesDone << " positions " << batch.positions << endl;
+	}
+
+	for (int i = 0; i < threads; i++)
+		workers[i].join();
+
+	int elapsed = max(1, getTimeMS() - start);
+
+	cout << "games " << batch.gamesDone << endl;
+	cout << "positions " << batch.positions << endl;
+	cout << "positions/s " << batch.positions * 1000 / elapsed << endl;
+}
+
+// a memory-mapped PGN file cut into chunks at game starts, workers take chunks in turn
+class PgnBatch {
+public:
+	const char *data = NULL;
+	size_t size = 0;
+	vector<size_t> chunks;
+	atomic<size_t> next{0};
+
+	atomic<long> games{0};
+	atomic<long> positions{0};
+	atomic<long> errors{0};
+
+	FILE *output = NULL;
+	mutex lock;
+
+	int skipPlies = 0;
+};
+
+static inline bool PgnSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// the next "[Event " tag at a line start after offset, the end of the file when there is none
+size_t PgnGameStart(PgnBatch *batch, size_t offset)
+{
+	const char *found = (const char *)memmem(batch->data + offset, batch->size - offset, "\n[Event ", 8);
+
+	return found ? found - batch->data + 1 : batch->size;
+}
+
+// PGN result token at p, NULL when p starts something else
+static inline const char *PgnResult(const char *p, const char *end)
+{
+	const char *results[] = { "1-0", "0-1", "1/2-1/2", "*" };
+
+	for (int i = 0; i < 4; i++)
+	{
+		size_t length = strlen(results[i]);
+
+		if ((size_t)(end - p) >= length && !memcmp(p, results[i], length) && (p + length == end || PgnSpace(p[length])))
+			return results[i];
+	}
+
+	return NULL;
+}
+
+// comments, variations, NAGs, move numbers and escape lines go by, the moves are played
+// from the FEN tag or the start position; positions of games with a result are written
+void PgnWorker(PgnBatch *batch)
+{
+	size_t index;
+	Engine *engine = new Engine;
+	string buffer;
+	vector<char> fens;
+
+	BindEngine(engine);
+
+	while ((index = batch->next++) + 1 < batch->chunks.size())
+	{
+		const char *p = batch->data + batch->chunks[index];
+		const char *end = batch->data + batch->chunks[index + 1];
+
+		while (p < end)
+		{
+			char fenTag[MAX_FEN_LENGTH + 32] = "";
+			const char *result = NULL;
+			const char *tagResult = "*";
+			bool valid = true;
+			int plies = 0;
+
+			while (p < end && PgnSpace(*p))
+				p++;
+
+			if (p >= end)
+				break;
+
+			// tag pairs, only FEN and Result matter here
+			while (p < end && *p == '[')
+			{
+				const char *line = p;
+				const char *value = (const char *)memchr(p, '"', end - p);
+
+				while (p < end && *p != '\n')
+					p++;
+
+				if (value && value < p)
+				{
+					const char *close = (const char *)memchr(value + 1, '"', p - value - 1);
+					size_t length = close ? close - value - 1 : 0;
+
+					if (!strncmp(line, "[FEN ", 5) && length < sizeof(fenTag))
+					{
+						memcpy(fenTag, value + 1, length);
+						fenTag[length] = '\0';
+					}
+					else if (!strncmp(line, "[Result ", 8) && close)
+						tagResult = PgnResult(value + 1, close) ? PgnResult(value + 1, close) : "*";
+				}
+
+				while (p < end && PgnSpace(*p))
+					p++;
+			}
+
+			ss->ply = 0;
+
+			if (*fenTag)
+				valid = ParseFen(pos, fenTag);
+			else
+				ParseFen(pos, startPosition);
+
+			fens.clear();
+
+			// movetext up to the result, or up to the next tag when the result is missing
+			while (p < end && !result && *p != '[')
+			{
+				if (PgnSpace(*p))
+					p++;
+				else if (*p == '{')
+				{
+					const char *close = (const char *)memchr(p, '}', end - p);
+					p = close ? close + 1 : end;
+				}
+				else if (*p == ';' || (*p == '%' && (p == batch->data || p[-1] == '\n')))
+				{
+					const char *close = (const char *)memchr(p, '\n', end - p);
+					p = close ? close + 1 : end;
+				}
+				else if (*p == '(')
+				{
+					// variations nest and may hold comments with parentheses of their own
+					for (int depth = 0; p < end; p++)
+					{
+						if (*p == '{')
+						{
+							const char *close = (const char *)memchr(p, '}', end - p);
+							p = close ? close : end - 1;
+						}
+						else if (*p == '(')
+							depth++;
+						else if (*p == ')' && --depth == 0)
+						{
+							p++;
+							break;
+						}
+					}
+				}
+				else if ((result = PgnResult(p, end)))
+					p += strlen(result);
+				else
+				{
+					const char *token = p;
+
+					while (p < end && !PgnSpace(*p) && !strchr("{}();[", *p))
+						p++;
+
+					// a stray closing brace or parenthesis
+					if (p == token)
+					{
+						p++;
+						continue;
+					}
+
+					// a move number, possibly glued to the move as in 12.e4 or 12...Nf6
+					const char *digits = token;
+
+					while (digits < p && isdigit(*digits))
+						digits++;
+
+					if (digits > token && digits < p && *digits == '.')
+					{
+						while (digits < p && *digits == '.')
+							digits++;
+
+						token = digits;
+					}
+
+					if (token == p || *token == '$' || !valid)
+						continue;
+
+					int move = ParseSan(token, p - token);
+
+					if (batch->output && plies >= batch->skipPlies)
+					{
+						fens.resize(fens.size() + MAX_FEN_LENGTH);
+						WriteFen(pos, &fens[fens.size() - MAX_FEN_LENGTH]);
+					}
+
+					// game moves stay at ply 0 like in ParsePosition, so the history needs no rewind
+					valid = move && pos->histPly < MAX_GAME_PLY - MAX_PLY && MakeMove(move);
+					plies++;
+				}
+			}
+
+			if (!result)
+				result = tagResult;
+
+			if (!valid)
+			{
+				batch->errors++;
+				continue;
+			}
+
+			batch->games++;
+
+			if (!batch->output || *result == '*')
+				continue;
+
+			for (size_t i = 0; i < fens.size(); i += MAX_FEN_LENGTH)
+			{
+				buffer += &fens[i];
+				buffer += " c9 \"";
+				buffer += result;
+				buffer += "\";\n";
+			}
+
+			batch->positions += fens.size() / MAX_FEN_LENGTH;
+
+			if (buffer.size() >= 1 << 20)
+			{
+				lock_guard<mutex> lock(batch->lock);
+				fwrite(buffer.data(), 1, buffer.size(), batch->output);
+				buffer.clear();
+			}
+		}
+	}
+
+	if (!buffer.empty())
+	{
+		lock_guard<mutex> lock(batch->lock);
+		fwrite(buffer.data(), 1, buffer.size(), batch->output);
+	}
+
+	delete engine;
+}
+
+// extract-pgn <file> [threads <n>] [skip <plies>] [output <file>]
+// replays every game, positions before each move go out as FEN lines tagged with the result
+void ExtractPgn(char *command)
+{
+	PgnBatch batch;
+	char path[4096];
+	char outputPath[4096] = "";
+	char *argument = NULL;
+	int threads = thread::hardware_concurrency();
+	vector<thread> workers;
+	struct stat st;
+
+	if (sscanf(command, "extract-pgn %4095s", path) != 1)
+	{
+		cout << "info string usage: extract-pgn <file> [threads <n>] [skip <plies>] [output <file>]" << endl;
+		return;
+	}
+
+	if ((argument = strstr(command, " threads ")))
+		threads = max(1, atoi(argument + 9));
+
+	if ((argument = strstr(command, " skip ")))
+		batch.skipPlies = max(0, atoi(argument + 6));
+
+	if ((argument = strstr(command, " output ")))
+		sscanf(argument + 8, "%4095s", outputPath);
+
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		cout << "info string cannot open " << path << endl;
+
+		if (fd >= 0)
+			close(fd);
+
+		return;
+	}
+
+	batch.size = st.st_size;
+	batch.data = batch.size ? (const char *)mmap(NULL, batch.size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+
+	if (batch.data == MAP_FAILED)
+	{
+		cout << "info string cannot map " << path << endl;
+		return;
+	}
+
+	if (batch.size)
+		madvise((void *)batch.data, batch.size, MADV_SEQUENTIAL);
+
+	if (*outputPath && !(batch.output = fopen(outputPath, "w")))
+	{
+		cout << "info string cannot create " << outputPath << endl;
+		munmap((void *)batch.data, batch.size);
+		return;
+	}
+
+	// chunks of about PGN_CHUNK_SIZE that start on a game, a game never spans two chunks
+	for (size_t offset = 0; offset < batch.size; )
+	{
+		batch.chunks.push_back(offset);
+		offset = offset + PGN_CHUNK_SIZE < batch.size ? PgnGameStart(&batch, offset + PGN_CHUNK_SIZE) : batch.size;
+	}
+
+	batch.chunks.push_back(batch.size);
+
+	int start = getTimeMS();
+
+	threads = max(1, min(threads, (int)batch.chunks.size() - 1));
+
+	for (int i = 0; i < threads; i++)
+		workers.emplace_back(PgnWorker, &batch);
+
+	for (int i = 0; i < threads; i++)
+		workers[i].join();
+
+	int elapsed = max(1, getTimeMS() - start);
+
+	if (batch.output)
+		fclose(batch.output);
+
+	if (batch.size)
+		munmap((void *)batch.data, batch.size);
+
+	cout << "games " << batch.games << endl;
+	cout << "errors " << batch.errors << endl;
+	cout << "positions " << batch.positions << endl;
+	cout << "time " << elapsed << " ms" << endl;
+	cout << "games/min " << (long)(batch.games * 60000.0 / elapsed) << endl;
+}
+
+// a UCI engine run as a child process, spoken to over two pipes
+class MatchEngine {
+public:
+	pid_t pid = -1;
+	int in = -1;        // the engine's stdin
+	int out = -1;       // the engine's stdout
+	string buffer;      // output read past the last complete line
+};
+
+// games are played in pairs from the same opening with colors swapped, the pair is the SPRT sample
+class MatchBatch {
+public:
+	string engines[2];
+	vector<string> options[2];
+	vector<string> openings;
+
+	string limit;       // "nodes <n>", "movetime <ms>" or "depth <n>", empty for a clock
+	int base = 10000;
+	int increment = 100;
+	int movetime = 0;
+
+	long pairs = MATCH_GAMES / 2;
+	atomic<long> next{0};
+	atomic<bool> stop{false};
+	bool failed = false;
+
+	double elo0 = 0, elo1 = 5, alpha = 0.05, beta = 0.05;
+
+	// results of the first engine, pentanomial[i] counts pairs that scored i half points of 4
+	mutex lock;
+	long wins = 0, losses = 0, draws = 0;
+	long pentanomial[5] = {};
+	long adjudicated = 0, forfeits = 0;
+};
+
+bool SendEngine(MatchEngine *engine, const string &text)
+{
+	for (size_t sent = 0; sent < text.size(); )
+	{
+		ssize_t count = write(engine->in, text.data() + sent, text.size() - sent);
+
+		if (count <= 0)
+			return false;
+
+		sent += count;
+	}
+
+	return true;
+}
+
+// false when the engine exits or nothing arrives within timeoutMs, a negative timeout waits forever
+bool ReadEngineLine(MatchEngine *engine, string &line, int timeoutMs)
+{
+	int deadline = getTimeMS() + timeoutMs;
+	size_t end;
+
+	while ((end = engine->buffer.find('\n')) == string::npos)
+	{
+		char chunk[4096];
+		struct pollfd fd = { engine->out, POLLIN, 0 };
+
+		if (poll(&fd, 1, timeoutMs < 0 ? -1 : max(0, deadline - getTimeMS())) <= 0)
+			return false;
+
+		ssize_t count = read(engine->out, chunk, sizeof(chunk));
+
+		if (count <= 0)
+			return false;
+
+		engine->buffer.append(chunk, count);
+	}
+
+	line = engine->buffer.substr(0, end && engine->buffer[end - 1] == '\r' ? end - 1 : end);
+	engine->buffer.erase(0, end + 1);
+
+	return true;
+}
+
+bool WaitEngine(MatchEngine *engine, const char *reply, int timeoutMs)
+{
+	string line;
+
+	while (ReadEngineLine(engine, line, timeoutMs))
+		if (line == reply)
+			return true;
+
+	return false;
+}
+
+// asks the engine to quit and kills it when it does not, the engine can be started again after
+void StopEngine(MatchEngine *engine)
+{
+	if (engine->pid < 0)
+		return;
+
+	SendEngine(engine, "quit\n");
+
+	close(engine->in);
+	close(engine->out);
+
+	for (int waited = 0; waitpid(engine->pid, NULL, WNOHANG) == 0; waited += 10)
+	{
+		if (waited >= MATCH_TIME_MARGIN)
+		{
+			kill(engine->pid, SIGKILL);
+			waitpid(engine->pid, NULL, 0);
+			break;
+		}
+
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+
+	engine->pid = -1;
+	engine->buffer.clear();
+}
+
+// runs the command through the shell, options are "name=value" or a button name
+bool StartEngine(MatchEngine *engine, const string &command, const vector<string> &options)
+{
+	int input[2], output[2];
+
+	// close-on-exec, or engines started by other workers would inherit and hold the pipes open
+	if (pipe2(input, O_CLOEXEC) < 0)
+		return false;
+
+	if (pipe2(output, O_CLOEXEC) < 0)
+	{
+		close(input[0]);
+		close(input[1]);
+		return false;
+	}
+
+	engine->pid = fork();
+
+	if (engine->pid == 0)
+	{
+		dup2(input[0], 0);
+		dup2(output[1], 1);
+		execl("/bin/sh", "sh", "-c", command.c_str(), (char *)NULL);
+		_exit(127);
+	}
+
+	close(input[0]);
+	close(output[1]);
+
+	engine->in = input[1];
+	engine->out = output[0];
+	engine->buffer.clear();
+
+	if (engine->pid < 0)
+	{
+		close(engine->in);
+		close(engine->out);
+		return false;
+	}
+
+	string setup;
+
+	for (size_t i = 0; i < options.size(); i++)
+	{
+		size_t split = options[i].find('=');
+
+		if (split == string::npos)
+			setup += "setoption name " + options[i] + "\n";
+		else
+			setup += "setoption name " + options[i].substr(0, split) + " value " + options[i].substr(split + 1) + "\n";
+	}
+
+	if (!SendEngine(engine, "uci\n") || !WaitEngine(engine, "uciok", MATCH_HANDSHAKE_MS)
+		|| !SendEngine(engine, setup + "isready\n") || !WaitEngine(engine, "readyok", MATCH_HANDSHAKE_MS))
+	{
+		StopEngine(engine);
+		return false;
+	}
+
+	return true;
+}
+
+// reads up to the bestmove, hasScore is false when the engine sent no score for its move
+bool EngineBestMove(MatchEngine *engine, int timeoutMs, char *move, int *score, bool *hasScore)
+{
+	string line;
+	const char *field;
+
+	*hasScore = false;
+
+	while (ReadEngineLine(engine, line, timeoutMs))
+	{
+		if (!strncmp(line.c_str(), "bestmove ", 9))
+			return sscanf(line.c_str() + 9, "%7s", move) == 1;
+
+		if (strncmp(line.c_str(), "info ", 5) || !strncmp(line.c_str(), "info string", 11))
+			continue;
+
+		if ((field = strstr(line.c_str(), " score cp ")))
+		{
+			*score = atoi(field + 10);
+			*hasScore = true;
+		}
+		else if ((field = strstr(line.c_str(), " score mate ")))
+		{
+			int moves = atoi(field + 12);
+
+			*score = moves > 0 ? MATE_VALUE - 2 * moves + 1 : -MATE_VALUE - 2 * moves;
+			*hasScore = true;
+		}
+	}
+
+	return false;
+}
+
+static inline bool ValidMoveString(const char *move)
+{
+	return strlen(move) >= 4 && move[0] >= 'a' && move[0] <= 'h' && move[1] >= '1' && move[1] <= '8'
+		&& move[2] >= 'a' && move[2] <= 'h' && move[3] >= '1' && move[3] <= '8';
+}
+
+// plays one game with players[first] on white, returns the half points of players[0]
+int PlayMatchGame(MatchBatch *batch, MatchEngine *players, int first, const string &opening)
+{
+	string moves;
+	int clocks[2] = { batch->base, batch->base };
+	int result = -1;
+	int lastScore = 0;
+	int winPlies = 0;
+	int drawPlies = 0;
+
+	for (int i = 0; i < 2; i++)
+	{
+		if (!SendEngine(&players[i], "ucinewgame\nisready\n") || !WaitEngine(&players[i], "readyok", MATCH_HANDSHAKE_MS))
+		{
+			StopEngine(&players[i]);
+
+			lock_guard<mutex> lock(batch->lock);
+			batch->forfeits++;
+
+			return i ? 2 : 0;
+		}
+	}
+
+	ParseFen(pos, opening.c_str());
+
+	// game moves are made at ply 0 so the repetition history holds the whole game
+	ss->ply = 0;
+
+	for (int plies = 0; (result = GameResult(plies)) < 0; plies++)
+	{
+		int side = pos->side;
+		MatchEngine *player = &players[side == WHITE ? first : first ^ 1];
+		string go = batch->limit;
+		int timeout = -1;
+
+		if (go.empty())
+		{
+			go = "wtime " + to_string(clocks[WHITE]) + " btime " + to_string(clocks[BLACK])
+				+ " winc " + to_string(batch->increment) + " binc " + to_string(batch->increment);
+			timeout = clocks[side] + MATCH_TIME_MARGIN;
+		}
+		else if (batch->movetime)
+			timeout = batch->movetime + MATCH_TIME_MARGIN;
+
+		char bestMove[8] = "";
+		int score = 0;
+		bool hasScore = false;
+		int start = getTimeMS();
+
+		bool answered = SendEngine(player, "position fen " + opening + (moves.empty() ? "" : " moves" + moves) + "\ngo " + go + "\n")
+			&& EngineBestMove(player, timeout, bestMove, &score, &hasScore);
+
+		int elapsed = getTimeMS() - start;
+		int move = answered && ValidMoveString(bestMove) ? ParseMove(bestMove) : 0;
+
+		// a crash, a hang, an illegal move or a fallen flag loses the game
+		if (!answered || !move || !MakeMove(move) || (batch->limit.empty() && elapsed > clocks[side]))
+		{
+			if (!answered)
+				StopEngine(player);
+
+			lock_guard<mutex> lock(batch->lock);
+			batch->forfeits++;
+
+			result = side == WHITE ? 0 : 2;
+			break;
+		}
+
+		clocks[side] += batch->increment - elapsed;
+		moves += " " + string(bestMove);
+
+		// both engines' scores count, each from white's point of view
+		int whiteScore = side == WHITE ? score : -score;
+
+		winPlies = hasScore && abs(whiteScore) >= MATCH_WIN_SCORE ? (winPlies && (whiteScore > 0) == (lastScore > 0) ? winPlies + 1 : 1) : 0;
+		drawPlies = hasScore && plies >= MATCH_DRAW_START && abs(whiteScore) <= MATCH_DRAW_SCORE ? drawPlies + 1 : 0;
+		lastScore = whiteScore;
+
+		if (winPlies >= MATCH_WIN_PLIES || drawPlies >= MATCH_DRAW_PLIES)
+		{
+			lock_guard<mutex> lock(batch->lock);
+			batch->adjudicated++;
+
+			result = drawPlies >= MATCH_DRAW_PLIES ? 1 : whiteScore > 0 ? 2 : 0;
+			break;
+		}
+	}
+
+	return first ? 2 - result : result;
+}
+
+static inline double EloFromScore(double score)
+{
+	score = max(1e-6, min(1 - 1e-6, score));
+
+	return 400 * log10(score / (1 - score));
+}
+
+// logistic Elo with a 95% margin and the SPRT log-likelihood ratio, both over game pairs
+void MatchEstimate(MatchBatch *batch, double *elo, double *margin, double *llr)
+{
+	long count = 0;
+	double sum = 0, squares = 0;
+
+	for (int i = 0; i < 5; i++)
+	{
+		count += batch->pentanomial[i];
+		sum += batch->pentanomial[i] * i / 4.0;
+		squares += batch->pentanomial[i] * (i / 4.0) * (i / 4.0);
+	}
+
+	double mean = count ? sum / count : 0.5;
+	double variance = count ? squares / count - mean * mean : 0;
+	double deviation = count ? sqrt(variance / count) : 0;
+
+	double s0 = 1 / (1 + pow(10, -batch->elo0 / 400));
+	double s1 = 1 / (1 + pow(10, -batch->elo1 / 400));
+
+	*elo = EloFromScore(mean);
+	*margin = (EloFromScore(mean + 1.96 * deviation) - EloFromScore(mean - 1.96 * deviation)) / 2;
+
+	// the normal approximation of the generalized SPRT, no information while every pair scored the same
+	*llr = variance > 0 ? count * (s1 - s0) * (2 * mean - s0 - s1) / (2 * variance) : 0;
+}
+
+void MatchWorker(MatchBatch *batch)
+{
+	long pair;
+	Engine *engine = new Engine;
+	MatchEngine players[2];
+
+	// no search here, the engine only follows the game for its rules and the tablebases
+	BindEngine(engine);
+
+	sInfo->uci = 0;
+
+	while (!batch->stop && (pair = batch->next++) < batch->pairs)
+	{
+		const string &opening = batch->openings[pair % batch->openings.size()];
+		int results[2];
+
+		for (int game = 0; game < 2; game++)
+		{
+			// a forfeited engine was stopped, it is started again for the next game
+			for (int i = 0; i < 2; i++)
+			{
+				if (players[i].pid < 0 && !StartEngine(&players[i], batch->engines[i], batch->options[i]))
+				{
+					lock_guard<mutex> lock(batch->lock);
+
+					if (!batch->failed)
+						cout << "info string cannot start " << batch->engines[i] << endl;
+
+					batch->failed = true;
+					batch->stop = true;
+				}
+			}
+
+			if (batch->failed)
+				break;
+
+			results[game] = PlayMatchGame(batch, players, game, opening);
+		}
+
+		if (batch->failed)
+			break;
+
+		double elo, margin, llr;
+		double lower = log(batch->beta / (1 - batch->alpha));
+		double upper = log((1 - batch->beta) / batch->alpha);
+
+		lock_guard<mutex> lock(batch->lock);
+
+		for (int game = 0; game < 2; game++)
+		{
+			batch->wins += results[game] == 2;
+			batch->draws += results[game] == 1;
+			batch->losses += results[game] == 0;
+		}
+
+		batch->pentanomial[results[0] + results[1]]++;
+
+		MatchEstimate(batch, &elo, &margin, &llr);
+
+		char estimate[128];
+
+		snprintf(estimate, sizeof(estimate), "elo %.1f +- %.1f llr %.2f (%.2f, %.2f)", elo, margin, llr, lower, upper);
+
+		cout << "info string match games " << batch->wins + batch->losses + batch->draws << " +" << batch->wins
+			<< " -" << batch->losses << " =" << batch->draws << " " << estimate << endl;
+
+		if (llr <= lower || llr >= upper)
+			batch->stop = true;
+	}
+
+	StopEngine(&players[0]);
+	StopEngine(&players[1]);
+
+	delete engine;
+}
+
+// match <engine1> <engine2> [games <n>] [concurrency <n>] [tc <s>+<s> | nodes <n> | movetime <ms> | depth <n>]
+//       [openings <file>] [syzygy <path>] [option1 <name>=<value>]... [option2 <name>=<value>]...
+//       [elo0 <x>] [elo1 <x>] [alpha <x>] [beta <x>]
+void Match(char *command)
+{
+	MatchBatch batch;
+	char first[4096], second[4096];
+	char path[4096];
+	char line[4096];
+	char *argument = NULL;
+	int concurrency = thread::hardware_concurrency();
+	long games = MATCH_GAMES;
+	vector<thread> workers;
+
+	if (sscanf(command, "match %4095s %4095s", first, second) != 2 || !strcmp(second, "games"))
+	{
+		cout << "info string usage: match <engine1> <engine2> [games <n>] [concurrency <n>] [tc <s>+<s> | nodes <n> | movetime <ms> | depth <n>]"
+			" [openings <file>] [syzygy <path>] [option1 <name>=<value>]... [option2 <name>=<value>]... [elo0 <x>] [elo1 <x>] [alpha <x>] [beta <x>]" << endl;
+		return;
+	}
+
+	batch.engines[0] = first;
+	batch.engines[1] = second;
+
+	if ((argument = strstr(command, " games ")))
+		games = max(2L, atol(argument + 7));
+
+	if ((argument = strstr(command, " concurrency ")))
+		concurrency = atoi(argument + 13);
+
+	if ((argument = strstr(command, " tc ")))
+	{
+		double base = 10, increment = 0;
+
+		sscanf(argument + 4, "%lf+%lf", &base, &increment);
+
+		batch.base = max(1, (int)(base * 1000));
+		batch.increment = max(0, (int)(increment * 1000));
+	}
+	else if ((argument = strstr(command, " nodes ")))
+		batch.limit = "nodes " + to_string(max(1L, atol(argument + 7)));
+	else if ((argument = strstr(command, " movetime ")))
+	{
+		batch.movetime = max(1, atoi(argument + 10));
+		batch.limit = "movetime " + to_string(batch.movetime);
+	}
+	else if ((argument = strstr(command, " depth ")))
+		batch.limit = "depth " + to_string(max(1, atoi(argument + 7)));
+
+	for (int i = 0; i < 2; i++)
+	{
+		const char *name = i ? " option2 " : " option1 ";
+
+		for (argument = strstr(command, name); argument; argument = strstr(argument + 1, name))
+			if (sscanf(argument + 9, "%4095s", line) == 1)
+				batch.options[i].push_back(line);
+	}
+
+	if ((argument = strstr(command, " elo0 ")))
+		batch.elo0 = atof(argument + 6);
+
+	if ((argument = strstr(command, " elo1 ")))
+		batch.elo1 = atof(argument + 6);
+
+	if ((argument = strstr(command, " alpha ")))
+		batch.alpha = max(1e-6, min(0.5, atof(argument + 7)));
+
+	if ((argument = strstr(command, " beta ")))
+		batch.beta = max(1e-6, min(0.5, atof(argument + 6)));
+
+	if ((argument = strstr(command, " syzygy ")) && sscanf(argument + 8, "%4095s", path) == 1)
+		TBInit(path);
+
+	if ((argument = strstr(command, " openings ")) && sscanf(argument + 10, "%4095s", path) == 1)
+	{
+		FILE *input = fopen(path, "r");
+
+		if (!input)
+		{
+			cout << "info string cannot open " << path << endl;
+			return;
+		}
+
+		// EPD, FEN or extract-pgn lines, sent to the engines as full six-field FENs
+		Position *check = new Position;
+
+		for (int lineNumber = 1; fgets(line, sizeof(line), input); lineNumber++)
+		{
+			string fen = EpdToFen(line);
+			const char *error = NULL;
+			char full[MAX_FEN_LENGTH];
+
+			if (fen.empty() || fen[0] == '#')
+				continue;
+
+			if (!ParseFen(check, fen.c_str(), &error))
+				cout << "info string line " << lineNumber << " skipped, invalid fen: " << error << endl;
+			else
+			{
+				WriteFen(check, full);
+				batch.openings.push_back(full);
+			}
+		}
+
+		delete check;
+
+		fclose(input);
+	}
+
+	if (batch.openings.empty())
+		batch.openings.push_back(startPosition);
+
+	batch.pairs = (games + 1) / 2;
+
+	// each game runs two engines but only one of them thinks at a time
+	concurrency = max(1, (int)min((long)concurrency, batch.pairs));
+
+	// an engine that exits while being written to must not take the match down with it
+	signal(SIGPIPE, SIG_IGN);
+
+	cout << "match " << batch.engines[0] << " vs " << batch.engines[1] << " games " << batch.pairs * 2 << " concurrency " << concurrency
+		<< " openings " << batch.openings.size() << " " << (batch.limit.empty() ? "tc " + to_string(batch.base) + "+" + to_string(batch.increment) + " ms" : batch.limit) << endl;
+
+	int start = getTimeMS();
+
+	for (int i = 0; i < concurrency; i++)
+		workers.emplace_back(MatchWorker, &batch);
+
+	for (int i = 0; i < concurrency; i++)
+		workers[i].join();
+
+	double elo, margin, llr;
+	double lower = log(batch.beta / (1 - batch.alpha));
+	double upper = log((1 - batch.beta) / batch.alpha);
+
+	MatchEstimate(&batch, &elo, &margin, &llr);
+
+	char estimate[128];
+
+	cout << "games " << batch.wins + batch.losses + batch.draws << endl;
+	cout << "wins " << batch.wins << " losses " << batch.losses << " draws " << batch.draws << endl;
+	cout << "pairs " << batch.pentanomial[0] << " " << batch.pentanomial[1] << " " << batch.pentanomial[2]
+		<< " " << batch.pentanomial[3] << " " << batch.pentanomial[4] << endl;
+	cout << "adjudicated " << batch.adjudicated << " forfeits " << batch.forfeits << endl;
+
+	snprintf(estimate, sizeof(estimate), "elo %.1f +- %.1f", elo, margin);
+	cout << estimate << endl;
+
+	snprintf(estimate, sizeof(estimate), "llr %.2f (%.2f, %.2f) elo0 %g elo1 %g", llr, lower, upper, batch.elo0, batch.elo1);
+	cout << estimate << " " << (llr >= upper ? "H1 accepted" : llr <= lower ? "H0 accepted" : "inconclusive") << endl;
+
+	cout << "time " << getTimeMS() - start << " ms" << endl;
+}
+
+void UciLoop()
+{
+	static char input[20000];
+
+	setbuf(stdin, NULL);
+	setbuf(stdout, NULL);
+
+	ParseFen(pos, startPosition);
+
+	while (true)
+	{
+		memset(input, 0, sizeof(input));
+
+		if (!pendingInput.empty())
+		{
+			size_t length = pendingInput.find('\n') + 1;
+
+			strncpy(input, pendingInput.c_str(), min(length, sizeof(input) - 1));
+			pendingInput.erase(0, length);
+		}
+		else if (sInfo->quit || !fgets(input, sizeof(input), stdin))
+			break;
+
+		if (!strncmp(input, "isready", 7))
+			cout << "readyok" << endl;
+		else if (!strncmp(input, "position", 8))
+			ParsePosition(input);
+		else if (!strncmp(input, "ucinewgame", 10))
+		{
+			ParseFen(pos, startPosition);
+			ClearHistory();
+
+			// a hash file is kept across games, ClearHash empties it explicitly
+			if (hashTable->path.empty())
+				ClearHash();
+		}
+		else if (!strncmp(input, "go", 2))
+			ParseGo(input);
+		else if (!strncmp(input, "setoption", 9))
+			ParseSetOption(input);
+		else if (!strncmp(input, "analyse-epd", 11))
+			AnalyseEpd(input);
+		else if (!strncmp(input, "bench", 5))
+			Bench(input);
+		else if (!strncmp(input, "datagen", 7))
+			Datagen(input);
+		else if (!strncmp(input, "extract-pgn", 11))
+			ExtractPgn(input);
+		else if (!strncmp(input, "match", 5))
+			Match(input);
+		else if (!strncmp(input, "quit", 4))
+			break;
+		else if (!strncmp(input, "uci", 3))
+		{
+			cout << "id name cppChess" << endl;
+			cout << "id author Lancer081" << endl;
+			cout << "option name Hash type spin default " << DEFAULT_HASH_MB << " min 1 max 65536" << endl;
+			cout << "option name HashFile type string default <empty>" << endl;
+			cout << "option name Ponder type check default false" << endl;
+			cout << "option name MultiPV type spin default 1 min 1 max " << MAX_MULTIPV << endl;
+			cout << "option name EvalCache type spin default " << DEFAULT_EVAL_CACHE_MB << " min 1 max 1024" << endl;
+			cout << "option name ClearHash type button" << endl;
+			cout << "option name SaveHash type button" << endl;
+			cout << "option name OwnBook type check default false" << endl;
+			cout << "option name BookFile type string default <empty>" << endl;
+			cout << "option name BookBestMove type check default false" << endl;
+			cout << "option name SyzygyPath type string default <empty>" << endl;
+			cout << "option name SyzygyProbeLimit type spin default 7 min 0 max 7" << endl;
+			cout << "uciok" << endl;
+		}
+		else if (!strncmp(input, "d", 1))
+			PrintBoard(pos);
+
+		if (sInfo->quit && sInfo->stopped)
+			break;
+	}
+}
+
+// builds that include this file for its internals (microbench) bring their own main
+#ifndef CPPCHESS_NO_MAIN
+int main(int argc, char *argv[])
+{
+	BindEngine(uciEngine);
+
+	if (!InitHash(DEFAULT_HASH_MB, "") || !InitEvalCache(DEFAULT_EVAL_CACHE_MB))
+	{
+		cout << "info string cannot allocate search tables" << endl;
+		return 1;
+	}
+
+	// a command given on the command line runs once instead of the UCI loop
+	if (argc > 1)
+	{
+		string command;
+
+		for (int i = 1; i < argc; i++)
+			command += string(argv[i]) + " ";
+
+		if (!strncmp(command.c_str(), "analyse-epd", 11))
+			AnalyseEpd(&command[0]);
+		else if (!strncmp(command.c_str(), "bench", 5))
+			Bench(&command[0]);
+		else if (!strncmp(command.c_str(), "datagen", 7))
+			Datagen(&command[0]);
+		else if (!strncmp(command.c_str(), "extract-pgn", 11))
+			ExtractPgn(&command[0]);
+		else if (!strncmp(command.c_str(), "match", 5))
+			Match(&command[0]);
+		else
+			cout << "unknown command: " << command << endl;
+	}
+	else
+		UciLoop();
+
+	SaveHash();
+	FreeHash();
+	FreeEvalCache();
+
+	return 0;
 }
+#endif
@@ -0,0 +1,397 @@
+// Micro-benchmarks for the engine kernels, built with "make microbench".
+// main.cpp is included directly so every static inline kernel is compiled
+// exactly as in the engine.
+//
+// usage: microbench [samples] [repetitions]
+
+#define CPPCHESS_NO_MAIN
+#include "main.cpp"
+
+#include <numeric>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+// the parts of a position the kernels read, a full Position is too large to keep thousands of
+class Sample {
+public:
+	uint64_t bb[12];
+	uint64_t occ[3];
+	uint8_t mailbox[64];
+	uint64_t hashKey;
+	int side;
+	int ep;
+	int ca;
+
+	// legal moves of the position, a range in the shared move array
+	int firstMove;
+	int moveCount;
+};
+
+vector<Sample> samples;
+vector<int> sampleMoves;
+vector<string> sampleFens;
+
+volatile uint64_t sink;
+
+static inline uint64_t ReadCycles()
+{
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static inline uint64_t ReadNs()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void LoadSample(const Sample *sample)
+{
+	memcpy(pos->bb, sample->bb, sizeof(pos->bb));
+	memcpy(pos->occ, sample->occ, sizeof(pos->occ));
+	memcpy(pos->mailbox, sample->mailbox, sizeof(pos->mailbox));
+
+	pos->hashKey = sample->hashKey;
+	pos->side = sample->side;
+	pos->ep = sample->ep;
+	pos->ca = sample->ca;
+	pos->fifty = 0;
+	pos->histPly = 0;
+	ss->ply = 0;
+	pos->attacks.valid = 0;
+}
+
+static inline uint64_t NextRandom(uint64_t &seed)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+
+	return seed * 0x2545F4914F6CDD1DULL;
+}
+
+// random games from the bench positions with a fixed seed, the sample is the same on every run
+void BuildSamples(int count)
+{
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	int start = 0;
+	int positions = 0;
+
+	while (benchPositions[positions])
+		positions++;
+
+	ParseFen(pos, benchPositions[0]);
+
+	while ((int)samples.size() < count)
+	{
+		MoveList moves[1];
+		int legal[256];
+		int legalCount = 0;
+
+		GenerateMoves(moves);
+
+		for (int i = 0; i < moves->count; i++)
+		{
+			if (MakeMove(moves->moves[i].move))
+			{
+				legal[legalCount++] = moves->moves[i].move;
+				TakeBack();
+			}
+		}
+
+		// a finished game restarts from the next bench position
+		if (!legalCount || pos->fifty >= 100)
+		{
+			ParseFen(pos, benchPositions[++start % positions]);
+			continue;
+		}
+
+		Sample sample;
+		char fen[MAX_FEN_LENGTH];
+
+		memcpy(sample.bb, pos->bb, sizeof(sample.bb));
+		memcpy(sample.occ, pos->occ, sizeof(sample.occ));
+		memcpy(sample.mailbox, pos->mailbox, sizeof(sample.mailbox));
+
+		sample.hashKey = pos->hashKey;
+		sample.side = pos->side;
+		sample.ep = pos->ep;
+		sample.ca = pos->ca;
+		sample.firstMove = sampleMoves.size();
+		sample.moveCount = legalCount;
+
+		sampleMoves.insert(sampleMoves.end(), legal, legal + legalCount);
+		samples.push_back(sample);
+
+		WriteFen(pos, fen);
+		sampleFens.push_back(fen);
+
+		MakeMove(legal[NextRandom(seed) % legalCount]);
+
+		// no search history is needed, keep hashHistory from filling up
+		pos->histPly = 0;
+	}
+}
+
+long KernelLoadSample()
+{
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		LoadSample(&samples[i]);
+		sink ^= pos->hashKey;
+	}
+
+	return samples.size();
+}
+
+long KernelRookAttacks()
+{
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+		for (int sq = 0; sq < 64; sq++)
+			result ^= GetRookAttacks(sq, samples[i].occ[BOTH]);
+
+	sink ^= result;
+
+	return samples.size() * 64;
+}
+
+long KernelBishopAttacks()
+{
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+		for (int sq = 0; sq < 64; sq++)
+			result ^= GetBishopAttacks(sq, samples[i].occ[BOTH]);
+
+	sink ^= result;
+
+	return samples.size() * 64;
+}
+
+long KernelIsSqAttacked()
+{
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		LoadSample(&samples[i]);
+
+		for (int sq = 0; sq < 64; sq++)
+			result += IsSqAttacked(sq, pos->side ^ 1);
+	}
+
+	sink ^= result;
+
+	return samples.size() * 64;
+}
+
+long KernelGenerateMoves()
+{
+	MoveList moves[1];
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		LoadSample(&samples[i]);
+		GenerateMoves(moves);
+		result += moves->count;
+	}
+
+	sink ^= result;
+
+	return samples.size();
+}
+
+long KernelMakeTakeBack()
+{
+	uint64_t result = 0;
+	long ops = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		LoadSample(&samples[i]);
+
+		for (int j = 0; j < samples[i].moveCount; j++)
+		{
+			MakeMove(sampleMoves[samples[i].firstMove + j]);
+			result ^= pos->hashKey;
+			TakeBack();
+		}
+
+		ops += samples[i].moveCount;
+	}
+
+	sink ^= result;
+
+	return ops;
+}
+
+long KernelEvaluate()
+{
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		LoadSample(&samples[i]);
+		result += Evaluate();
+	}
+
+	sink ^= result;
+
+	return samples.size();
+}
+
+// the second and later passes find every sample in the cache, this is the cost of a hit
+long KernelCachedEvaluate()
+{
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		LoadSample(&samples[i]);
+		result += CachedEvaluate();
+	}
+
+	sink ^= result;
+
+	return samples.size();
+}
+
+long KernelHashKey()
+{
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		LoadSample(&samples[i]);
+		result ^= generateHashKey(pos);
+	}
+
+	sink ^= result;
+
+	return samples.size();
+}
+
+long KernelParseFen()
+{
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < sampleFens.size(); i++)
+	{
+		ParseFen(pos, sampleFens[i].c_str());
+		result ^= pos->hashKey;
+	}
+
+	sink ^= result;
+
+	return sampleFens.size();
+}
+
+long KernelWriteFen()
+{
+	char fen[MAX_FEN_LENGTH];
+	uint64_t result = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		LoadSample(&samples[i]);
+		result += WriteFen(pos, fen);
+	}
+
+	sink ^= result;
+
+	return samples.size();
+}
+
+class Kernel {
+public:
+	const char *name;
+	long (*run)();
+};
+
+const Kernel kernels[] = {
+	{ "LoadSample", KernelLoadSample },
+	{ "GetRookAttacks", KernelRookAttacks },
+	{ "GetBishopAttacks", KernelBishopAttacks },
+	{ "IsSqAttacked", KernelIsSqAttacked },
+	{ "GenerateMoves", KernelGenerateMoves },
+	{ "MakeMove+TakeBack", KernelMakeTakeBack },
+	{ "Evaluate", KernelEvaluate },
+	{ "CachedEvaluate", KernelCachedEvaluate },
+	{ "generateHashKey", KernelHashKey },
+	{ "ParseFen", KernelParseFen },
+	{ "WriteFen", KernelWriteFen },
+};
+
+static double Median(vector<double> values)
+{
+	sort(values.begin(), values.end());
+
+	return values[values.size() / 2];
+}
+
+static double StdDev(const vector<double> &values)
+{
+	double mean = accumulate(values.begin(), values.end(), 0.0) / values.size();
+	double sum = 0.0;
+
+	for (size_t i = 0; i < values.size(); i++)
+		sum += (values[i] - mean) * (values[i] - mean);
+
+	return sqrt(sum / values.size());
+}
+
+int main(int argc, char *argv[])
+{
+	int count = argc > 1 ? atoi(argv[1]) : 10000;
+	int repetitions = argc > 2 ? atoi(argv[2]) : 15;
+
+	count = max(1, count);
+	repetitions = max(1, repetitions);
+
+	BindEngine(uciEngine);
+	InitEvalCache(DEFAULT_EVAL_CACHE_MB);
+
+	BuildSamples(count);
+
+	printf("%zu positions, %zu moves, %d repetitions after one warmup pass\n", samples.size(), sampleMoves.size(), repetitions);
+	printf("per-position kernels include one LoadSample per position\n\n");
+	printf("%-20s %10s %10s %10s %12s %12s\n", "kernel", "ns/op", "min", "stddev", "cycles/op", "Mops/s");
+
+	for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+	{
+		vector<double> ns;
+		vector<double> cycles;
+
+		kernels[i].run();
+
+		for (int r = 0; r < repetitions; r++)
+		{
+			uint64_t startNs = ReadNs();
+			uint64_t startCycles = ReadCycles();
+
+			long ops = kernels[i].run();
+
+			uint64_t endCycles = ReadCycles();
+			uint64_t endNs = ReadNs();
+
+			ns.push_back((double)(endNs - startNs) / ops);
+			cycles.push_back((double)(endCycles - startCycles) / ops);
+		}
+
+		double median = Median(ns);
+
+		printf("%-20s %10.2f %10.2f %10.2f %12.2f %12.2f\n", kernels[i].name, median,
+			*min_element(ns.begin(), ns.end()), StdDev(ns), Median(cycles), 1e3 / median);
+	}
+
+	return 0;
+}
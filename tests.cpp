@@ -0,0 +1,142 @@
+// Regression tests, built and run with "make test". main.cpp is included directly like in
+// microbench.cpp so the tests see every static inline function.
+//
+// usage: tests [syzygy path], the tablebase probes only run when a path with the 3- and
+// 4-man files is given
+
+#define CPPCHESS_NO_MAIN
+#include "main.cpp"
+
+int failures = 0;
+
+#define CHECK(expr) do { if (!(expr)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #expr); failures++; } } while (0)
+
+static string CurrentFen()
+{
+	char fen[MAX_FEN_LENGTH];
+
+	WriteFen(pos, fen);
+
+	return fen;
+}
+
+// "position fen" as a GUI sends it, the line still ends in its newline
+static string PositionFen(const char *line)
+{
+	char command[4096];
+
+	snprintf(command, sizeof(command), "%s", line);
+	ParsePosition(command);
+
+	return CurrentFen();
+}
+
+void TestFen()
+{
+	CHECK(PositionFen("position fen 8/8/8/4k3/8/8/8/4K2R w K -\n") == "8/8/8/4k3/8/8/8/4K2R w K - 0 1");
+	CHECK(PositionFen("position fen 8/8/8/4k3/8/8/8/4K2R b - -\r\n") == "8/8/8/4k3/8/8/8/4K2R b - - 0 1");
+	CHECK(PositionFen("position fen 8/8/8/4k3/8/8/8/4K2R w -\n") == "8/8/8/4k3/8/8/8/4K2R w - - 0 1");
+	CHECK(PositionFen("position fen 8/8/8/4k3/8/8/8/4K2R w K - 5 30\n") == "8/8/8/4k3/8/8/8/4K2R w K - 5 30");
+	CHECK(PositionFen("position fen rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3\n moves e7e5\n")
+		== "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2");
+
+	Position *check = new Position;
+
+	CHECK(!ParseFen(check, "8/8/8/4k3/8/8/8/4K2R w X -\n"));
+	CHECK(!ParseFen(check, "8/8/8/4k3/8/8/8/4K2R w K e9\n"));
+	CHECK(!ParseFen(check, "8/8/8/4k3/8/8/8/4K2 w - -\n"));
+
+	delete check;
+}
+
+class TablebaseCase {
+public:
+	const char *fen;
+	int wdl;
+	int dtz;    // checked only when the sign alone is not enough, 0 for any value
+};
+
+// wins, losses and draws anyone can verify by hand, DTZ 1 where the winning move zeroes
+const TablebaseCase tablebaseCases[] = {
+	{ "k7/8/1K6/8/8/8/8/7R w - - 0 1", WDL_WIN, 1 },            // KRvK, Rh8 mates
+	{ "8/4P3/8/8/8/8/k7/4K3 w - - 0 1", WDL_WIN, 1 },           // KPvK, e8=Q
+	{ "4k3/8/4K3/4P3/8/8/8/8 w - - 0 1", WDL_WIN, 0 },          // KPvK, king on the sixth
+	{ "4k3/8/4K3/4P3/8/8/8/8 b - - 0 1", WDL_LOSS, 0 },
+	{ "7k/8/8/8/8/8/7P/7K w - - 0 1", WDL_DRAW, 0 },            // KPvK, rook pawn
+	{ "4k3/8/8/8/8/8/8/1N2K3 w - - 0 1", WDL_DRAW, 0 },         // KNvK
+	{ "3rk3/8/8/8/8/8/8/3RK3 w - - 0 1", WDL_DRAW, 0 },         // KRvKR
+	{ "4k3/8/8/8/8/8/8/3QK1n1 w - - 0 1", WDL_WIN, 0 },         // KQvKN
+	{ "4k3/8/8/8/8/8/8/3QK1n1 b - - 0 1", WDL_LOSS, 0 },
+	{ "4k3/8/8/8/8/8/8/R3K1nR w - - 0 1", WDL_WIN, 0 },         // KRRvKN
+	{ "4k3/8/8/8/8/8/8/R3K1nR b - - 0 1", WDL_LOSS, 0 },
+};
+
+void TestTablebases(const char *path)
+{
+	TBInit(path);
+
+	CHECK(syzygy->largest >= 4);
+
+	if (syzygy->largest < 4)
+	{
+		TBInit("");
+		return;
+	}
+
+	for (size_t i = 0; i < sizeof(tablebaseCases) / sizeof(tablebaseCases[0]); i++)
+	{
+		const TablebaseCase *test = &tablebaseCases[i];
+		int result;
+
+		ParseFen(pos, test->fen);
+
+		if (CountBits(pos->occ[BOTH]) > syzygy->largest)
+		{
+			printf("tablebase case %s skipped, no %d-man tables\n", test->fen, CountBits(pos->occ[BOTH]));
+			continue;
+		}
+
+		int wdl = TBProbeWDL(&result);
+
+		CHECK(result != PROBE_FAIL && wdl == test->wdl);
+
+		int dtz = TBProbeDTZ(&result);
+
+		CHECK(result != PROBE_FAIL);
+		CHECK(test->wdl == WDL_WIN ? dtz > 0 : test->wdl == WDL_LOSS ? dtz < 0 : dtz == 0);
+		CHECK(!test->dtz || dtz == test->dtz);
+	}
+
+	// the root ranking keeps the one mating move
+	int score;
+
+	ParseFen(pos, tablebaseCases[0].fen);
+
+	CHECK(TBRootProbe(&score) == 1 && MoveString(ss->searchMoves[0]) == "h1h8" && score == TB_WIN_SCORE);
+
+	ss->searchMoveCount = 0;
+
+	TBInit("");
+}
+
+int main(int argc, char *argv[])
+{
+	BindEngine(uciEngine);
+	InitHash(DEFAULT_HASH_MB, "");
+	InitEvalCache(DEFAULT_EVAL_CACHE_MB);
+
+	TestFen();
+
+	// the tables are not in the repository, make test SYZYGY=<dir> runs these
+	if (argc > 1)
+		TestTablebases(argv[1]);
+	else
+		printf("tablebase tests skipped, no syzygy path given\n");
+
+	FreeHash();
+	FreeEvalCache();
+
+	printf("%s\n", failures ? "tests failed" : "tests passed");
+
+	return failures != 0;
+}